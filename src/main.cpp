@@ -6,15 +6,59 @@
 #include <math.h>
 #include <random>
 #include <algorithm>
+#include <span>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <stop_token>
+#include <deque>
+#include <variant>
+#include <functional>
+#include <condition_variable>
+#include <chrono>
+#include <filesystem>
 
 #include <imgui.h>
 #include <imgui_impl_sdl3.h>
 #include <imgui_impl_opengl3.h>
 #include <imgui_stdlib.h>
 
+#include <nlohmann/json.hpp>
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <string.h>
+#include <assert.h>
+#include <ctype.h>
 #include <SDL3/SDL.h>
 
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// SSE2 is always there on x86-64, AVX2 is checked for at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCREEN_PROJECTION_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
 #if defined(IMGUI_IMPL_OPENGL_ES2)
 #include <SDL3/SDL_opengles2.h>
 #else
@@ -146,806 +190,7700 @@ public:
 	}
 };
 
-class wad_header_c
+class profiler_c
 {
 public:
-	char type[4];
-	int32_t lump_count;
-	int32_t directory_offset;
-};
+	enum stage_e
+	{
+		STAGE_FRAME,
+		STAGE_POLL,
+		STAGE_REGIONS,
+		STAGE_MAP,
+		STAGE_MENU_BAR,
+		STAGE_PROCESS,
+		STAGE_COUNT
+	};
 
-class wad_lump_c
-{
-public:
-	int32_t offset;
-	int32_t size;
-	char name[8];
+	static constexpr const char *STAGE_NAMES[STAGE_COUNT] = {
+		"DoFrame",
+		"Frame_Poll",
+		"DrawRegions",
+		"DrawMap",
+		"DrawMenuBar",
+		"Frame_Process",
+	};
 
-	template<typename T>
-		bool load_as_vector(FILE *file_ptr, const char *safety_name, std::vector<T> &elements)
+	struct stage_stats_s
+	{
+		float last;
+		float min;
+		float avg;
+		float p99;
+	};
+
+	struct trace_event_s
 	{
-		assert(file_ptr != nullptr);
+		int stage;
+		int64_t start_us;
+		int64_t duration_us;
+	};
 
-		if (strlen(safety_name) == 0 || strncmp(safety_name, name, 8) == 0)
-		{
-			auto count = size / sizeof(T);
-			elements.resize(count);
+	static constexpr int HISTORY_SIZE = 240;
+	static constexpr size_t TRACE_EVENT_MAX = 1000000;
 
-			fseek(file_ptr, offset, SEEK_SET);
-			fread(elements.data(), sizeof(T), count, file_ptr);
+	typedef std::chrono::steady_clock profile_clock_t;
 
-			printf("Loaded lump %s\n", safety_name);
-			return true;
-		}
+	// Milliseconds per stage, as a ring buffer of the last HISTORY_SIZE frames
+	float history[STAGE_COUNT][HISTORY_SIZE];
+	int history_pos;
+	int history_count;
+
+	// Totals from the last ImDrawData submitted
+	int draw_lists;
+	int draw_commands;
+	int draw_vertices;
+	int draw_indices;
+	int background_commands;
+	int background_vertices;
+
+	profile_clock_t::time_point origin;
+	bool tracing;
+	std::vector<trace_event_s> trace_events;
 
-		return false;
+	profiler_c() : history{}, history_pos(0), history_count(0),
+		draw_lists(0), draw_commands(0), draw_vertices(0), draw_indices(0),
+		background_commands(0), background_vertices(0),
+		origin(profile_clock_t::now()), tracing(false)
+	{
 	}
-};
 
-class wad_c
-{
-public:
-	bool valid;
-	FILE *file_ptr;
-	wad_header_c header;
-	std::vector<wad_lump_c> directory;
+	void Record(int stage, profile_clock_t::time_point start, profile_clock_t::time_point end)
+	{
+		history[stage][history_pos] = std::chrono::duration<float, std::milli>(end - start).count();
+
+		if (tracing == true && trace_events.size() < TRACE_EVENT_MAX)
+		{
+			trace_events.push_back({
+				stage,
+				std::chrono::duration_cast<std::chrono::microseconds>(start - origin).count(),
+				std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()
+			});
+		}
+	}
 
-	wad_c(const char *wad_path)
+	void EndFrame(void)
 	{
-		printf("Attempting to open file: %s\n", wad_path);
-		file_ptr = fopen(wad_path, "rb");
-		if (file_ptr == nullptr)
+		history_pos = (history_pos + 1) % HISTORY_SIZE;
+		history_count = std::min(history_count + 1, HISTORY_SIZE - 1);
+
+		for (int i = 0; i < STAGE_COUNT; ++i)
 		{
-			printf("Cannot open file: %s\n", wad_path);
-			return;
+			history[i][history_pos] = 0.0f;
 		}
+	}
 
-		fread(&header, sizeof(header), 1, file_ptr);
-		if (strncmp(header.type, "PWAD", 4) != 0
-			&& strncmp(header.type, "IWAD", 4) != 0)
+	stage_stats_s Stats(int stage) const
+	{
+		stage_stats_s stats = {};
+		if (history_count <= 0)
 		{
-			printf("File is not a WAD\n");
-			return;
+			return stats;
 		}
 
-		if (header.lump_count <= 0)
+		float samples[HISTORY_SIZE];
+		float total = 0.0f;
+
+		for (int i = 0; i < history_count; ++i)
 		{
-			printf("File has no lumps\n");
-			return;
+			// Walk backwards from the most recently finished frame
+			int index = (history_pos - 1 - i + HISTORY_SIZE) % HISTORY_SIZE;
+			samples[i] = history[stage][index];
+			total += samples[i];
 		}
 
-		directory.resize(header.lump_count);
-		fseek(file_ptr, header.directory_offset, SEEK_SET);
-		fread(directory.data(), sizeof(wad_lump_c), header.lump_count, file_ptr);
+		stats.last = samples[0];
+		stats.min = *std::min_element(samples, samples + history_count);
+		stats.avg = total / history_count;
 
-		printf("Finished opening WAD\n");
-		valid = true;
+		int p99_index = std::min(history_count - 1, (history_count * 99) / 100);
+		std::nth_element(samples, samples + p99_index, samples + history_count);
+		stats.p99 = samples[p99_index];
+
+		return stats;
 	}
 
-	~wad_c()
+	void RecordDrawData(const ImDrawData *draw_data, const ImDrawList *background_list)
 	{
-		if (file_ptr != nullptr)
+		draw_lists = draw_data->CmdListsCount;
+		draw_commands = 0;
+		draw_vertices = draw_data->TotalVtxCount;
+		draw_indices = draw_data->TotalIdxCount;
+		background_commands = 0;
+		background_vertices = 0;
+
+		for (int i = 0; i < draw_data->CmdListsCount; ++i)
 		{
-			fclose(file_ptr);
-			file_ptr = nullptr;
+			const ImDrawList *list = draw_data->CmdLists[i];
+			draw_commands += list->CmdBuffer.Size;
+
+			if (list == background_list)
+			{
+				background_commands = list->CmdBuffer.Size;
+				background_vertices = list->VtxBuffer.Size;
+			}
 		}
 	}
-};
 
-struct map_thing_s
-{
-	int16_t x;
-	int16_t y;
-	int16_t angle;
-	int16_t doomednum;
-	int16_t flags;
-};
+	void StartTrace(void)
+	{
+		trace_events.clear();
+		tracing = true;
+	}
 
-struct map_linedef_s
-{
-	int16_t vertex_id_a;
-	int16_t vertex_id_b;
-	int16_t flags;
-	int16_t action;
-	int16_t tag;
-	int16_t side_id_front;
-	int16_t side_id_back;
-};
+	// Writes everything recorded since StartTrace in Chrome's trace event format,
+	// which chrome://tracing and Perfetto can both open.
+	bool WriteTrace(const char *path)
+	{
+		tracing = false;
 
-struct map_sidedef_s
-{
-	int16_t x_offset;
-	int16_t y_offset;
-	char texture_upper[8];
-	char texture_lower[8];
-	char texture_middle[8];
-	int16_t sector_id;
-};
+		nlohmann::json events = nlohmann::json::array();
+		for (const auto &event : trace_events)
+		{
+			events.push_back({
+				{ "name", STAGE_NAMES[event.stage] },
+				{ "cat", "frame" },
+				{ "ph", "X" },
+				{ "ts", event.start_us },
+				{ "dur", event.duration_us },
+				{ "pid", 1 },
+				{ "tid", 1 },
+			});
+		}
 
-struct map_vertex_s
-{
-	int16_t x;
-	int16_t y;
-};
+		nlohmann::json trace = {
+			{ "traceEvents", events },
+			{ "displayTimeUnit", "ms" },
+		};
 
-/*
-struct map_seg_s
-{
-	uint16_t vertex_id_a;
-	uint16_t vertex_id_b;
-	int16_t angle;
-	uint16_t linedef_id;
-	int16_t side;
-	int16_t offset;
-};
+		FILE *file_ptr = fopen(path, "wb");
+		if (file_ptr == nullptr)
+		{
+			printf("Cannot write trace file: %s\n", path);
+			return false;
+		}
 
-struct map_subsector_s
-{
-	int16_t seg_count;
-	int16_t seg_id;
-};
+		std::string output = trace.dump();
+		fwrite(output.data(), 1, output.size(), file_ptr);
+		fclose(file_ptr);
 
-struct map_node_s
-{
-	int16_t partition_x;
-	int16_t partition_y;
-	int16_t partition_x_delta;
-	int16_t partition_y_delta;
-	int16_t bbox_right[4];
-	int16_t bbox_left[4];
-	int16_t child_right;
-	int16_t child_left;
+		printf("Wrote %zu trace events to %s\n", trace_events.size(), path);
+		trace_events.clear();
+		return true;
+	}
 };
-*/
 
-struct map_sector_s
+class profile_scope_c
 {
-	int16_t floor_height;
-	int16_t ceiling_height;
-	char floor_texture[8];
-	char ceiling_texture[8];
-	int16_t light;
-	int16_t special;
-	int16_t tag;
+public:
+	profiler_c &profiler;
+	int stage;
+	profiler_c::profile_clock_t::time_point start;
+
+	profile_scope_c(profiler_c &profiler_ref, int stage_id) : profiler(profiler_ref), stage(stage_id), start(profiler_c::profile_clock_t::now())
+	{
+	}
+
+	~profile_scope_c()
+	{
+		profiler.Record(stage, start, profiler_c::profile_clock_t::now());
+	}
 };
 
-class map_c
+class thread_pool_c
 {
 public:
-	std::atomic_bool loaded;
-	const char *name;
+	class worker_queue_c
+	{
+	public:
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<worker_queue_c>> queues;
+	std::vector<std::thread> threads;
 
-	std::vector<map_thing_s> things;
-	std::vector<map_linedef_s> linedefs;
-	std::vector<map_sidedef_s> sidedefs;
-	std::vector<map_vertex_s> vertices;
-	std::vector<map_sector_s> sectors;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	std::atomic<int> queued;
+	std::atomic<unsigned> next_queue;
+	std::atomic_bool quit;
 
-	map_c(wad_c &wad, const char *map_name) : loaded(false), name(map_name)
+	static thread_local thread_pool_c *current_pool;
+	static thread_local int current_worker;
+
+	thread_pool_c(unsigned thread_count = 0) : queued(0), next_queue(0), quit(false)
 	{
-		if (wad.valid == false)
+		if (thread_count == 0)
 		{
-			printf("Tried to load map from invalid WAD\n");
-			return;
+			thread_count = std::max(1u, std::thread::hardware_concurrency());
 		}
 
-		for (int i = 0, len = (int)wad.directory.size(); i < len; ++i)
+		for (unsigned i = 0; i < thread_count; ++i)
 		{
-			auto &map_lump = wad.directory[i];
-			printf("Lump: %s\n", map_lump.name);
-
-			if (strncmp(name, map_lump.name, 8) == 0)
-			{
-				for (int j = 1; j < 8; ++i)
-				{
-					if (i + j >= len)
-					{
-						break;
-					}
-
-					auto &resource_lump = wad.directory[i + j];
-
-					resource_lump.load_as_vector(wad.file_ptr, "THINGS", things);
-					resource_lump.load_as_vector(wad.file_ptr, "LINEDEFS", linedefs);
-					resource_lump.load_as_vector(wad.file_ptr, "SIDEDEFS", sidedefs);
-					resource_lump.load_as_vector(wad.file_ptr, "VERTEXES", vertices);
-					resource_lump.load_as_vector(wad.file_ptr, "SECTORS", sectors);
-				}
-
-				printf("Map successfully loaded\n");
-				loaded = true;
-				return;
-			}
+			queues.push_back(std::make_unique<worker_queue_c>());
 		}
 
-		printf("No map lump labelled %s\n", map_name);
+		for (unsigned i = 0; i < thread_count; ++i)
+		{
+			threads.emplace_back([this, i]() { WorkerLoop((int)i); });
+		}
 	}
-};
 
-class region_c
-{
-public:
-	std::string title;
-	std::map<std::string, bool> rules;
-	ImVec2 rect_vertex_a, rect_vertex_b;
-	double rect_color[3];
+	thread_pool_c(const thread_pool_c &) = delete;
+	thread_pool_c &operator=(const thread_pool_c &) = delete;
 
-	region_c()
+	~thread_pool_c()
 	{
-		title = "Untitled region";
-
-		rect_vertex_a = ImVec2(-64.0f, -64.0f);
-		rect_vertex_b = ImVec2(64.0f, 64.0f);
-
-		double hue = (float)(rand()) / (float)(RAND_MAX);
-		rect_color[0] = hue;
-		rect_color[1] = 1.0f;
-		rect_color[2] = 0.0f;
-
-		for (int i = 2; i > 0; i--)
 		{
-			int j = rand() % (i + 1);
+			std::lock_guard<std::mutex> lock(wake_mutex);
+			quit = true;
+		}
+		wake.notify_all();
 
-			double tmp = rect_color[i];
-			rect_color[i] = rect_color[j];
-			rect_color[j] = tmp;
+		for (auto &thread : threads)
+		{
+			thread.join();
 		}
 	}
-};
-
-class main_c
-{
-public:
-	class sdl_c sdl;
-	class imgui_c imgui;
-
-	class map_c *cur_map;
-	std::vector<region_c> regions;
-	int selected_region_id;
-
-	const float GRID_STEP = 64.0f;
-	const float GRID_MIN = -32768.0f;
-	const float GRID_MAX = 32767.0f;
-
-	const float ZOOM_MIN = 0.01f;
-	const float ZOOM_MAX = 1.0f;
-	const float ZOOM_BASE = 2.0f;
 
-	enum grab_handle_e
+	// Shared by everything that wants to spread work across the machine.
+	static thread_pool_c &Shared(void)
 	{
-		GRAB_NULL = 0,
-		GRAB_TOP = 1 << 0,
-		GRAB_LEFT = 1 << 1,
-		GRAB_BOTTOM = 1 << 2,
-		GRAB_RIGHT = 1 << 3,
-		GRAB_ALL = GRAB_TOP|GRAB_LEFT|GRAB_BOTTOM|GRAB_RIGHT,
-	};
+		static thread_pool_c pool;
+		return pool;
+	}
 
-	ImVec2 scroll;
-	float zoom;
-	ImVec2 work_pos, work_size;
+	int ThreadCount(void) const
+	{
+		return (int)threads.size();
+	}
 
-	main_c() : scroll(ImVec2(0.0f, 0.0f)), zoom(0.5f)
+	void Submit(std::function<void()> task)
 	{
-		printf("main_c constructor\n");
+		// Workers push onto their own queue, which they'll pop from the back,
+		// while everyone else spreads tasks out round-robin.
+		int index = (current_pool == this) ? current_worker : (int)(next_queue++ % queues.size());
 
-		if (sdl.window == nullptr)
 		{
-			return;
+			std::lock_guard<std::mutex> lock(queues[index]->mutex);
+			queues[index]->tasks.push_back(std::move(task));
 		}
 
-		// Setup Platform/Renderer backends
-		ImGui_ImplSDL3_InitForOpenGL(sdl.window, sdl.gl_context);
-		ImGui_ImplOpenGL3_Init(sdl.glsl_version);
-
-		imgui.context_valid = true;
-	}
-
-	~main_c()
-	{
-		printf("main_c destructor\n");
-		delete cur_map;
-		imgui.~imgui_c();
-		sdl.~sdl_c();
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex);
+			queued++;
+		}
+		wake.notify_one();
 	}
 
-	bool Frame_Poll(void)
+	// Runs one task, preferring the newest from our own queue,
+	// and otherwise stealing the oldest from somebody else's.
+	bool TryRunOne(int own_index)
 	{
-		SDL_Event event;
-		bool done = false;
+		std::function<void()> task;
+		const int count = (int)queues.size();
 
-		while (SDL_PollEvent(&event))
+		for (int i = 0; i < count && !task; ++i)
 		{
-			ImGui_ImplSDL3_ProcessEvent(&event);
+			int index = (own_index >= 0) ? ((own_index + i) % count) : i;
+			auto &queue = *queues[index];
 
-			if (event.type == SDL_EVENT_QUIT)
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty() == true)
 			{
-				done = true;
+				continue;
 			}
 
-			if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED && event.window.windowID == SDL_GetWindowID(sdl.window))
+			if (index == own_index)
 			{
-				done = true;
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
 			}
 		}
 
-		return done;
+		if (!task)
+		{
+			return false;
+		}
+
+		queued--;
+		task();
+		return true;
 	}
 
-	void Frame_Init(void)
+	void WorkerLoop(int index)
 	{
-		// Start the Dear ImGui frame
+		current_pool = this;
+		current_worker = index;
+
+		while (true)
+		{
+			if (TryRunOne(index) == true)
+			{
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			wake.wait(lock, [this]() { return (quit == true || queued > 0); });
+
+			if (quit == true && queued <= 0)
+			{
+				break;
+			}
+		}
+	}
+
+	// Runs func(0) through func(count - 1) across the pool and waits for all of them.
+	// The calling thread helps out, so this is safe to use from inside a task.
+	void ParallelFor(int count, const std::function<void(int)> &func)
+	{
+		std::atomic<int> remaining = count;
+
+		for (int i = 0; i < count; ++i)
+		{
+			Submit([&func, &remaining, i]()
+			{
+				func(i);
+				remaining--;
+			});
+		}
+
+		const int own_index = (current_pool == this) ? current_worker : -1;
+		while (remaining > 0)
+		{
+			if (TryRunOne(own_index) == false)
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+};
+
+thread_local thread_pool_c *thread_pool_c::current_pool = nullptr;
+thread_local int thread_pool_c::current_worker = -1;
+
+class file_mapping_c
+{
+public:
+	const uint8_t *data;
+	size_t size;
+	bool mapped;
+
+	// Only used when the file couldn't be mapped, or mapping was disabled.
+	std::vector<uint8_t> buffer;
+
+#if defined(_WIN32)
+	HANDLE file_handle;
+	HANDLE map_handle;
+#else
+	int file_desc;
+#endif
+
+	file_mapping_c() : data(nullptr), size(0), mapped(false)
+	{
+#if defined(_WIN32)
+		file_handle = INVALID_HANDLE_VALUE;
+		map_handle = nullptr;
+#else
+		file_desc = -1;
+#endif
+	}
+
+	file_mapping_c(const file_mapping_c &) = delete;
+	file_mapping_c &operator=(const file_mapping_c &) = delete;
+
+	~file_mapping_c()
+	{
+		Close();
+	}
+
+	bool Map(const char *path)
+	{
+#if defined(_WIN32)
+		file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file_handle == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER file_size;
+		if (GetFileSizeEx(file_handle, &file_size) == FALSE || file_size.QuadPart <= 0)
+		{
+			return false;
+		}
+
+		map_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (map_handle == nullptr)
+		{
+			return false;
+		}
+
+		void *view = MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+		if (view == nullptr)
+		{
+			return false;
+		}
+
+		data = (const uint8_t *)view;
+		size = (size_t)file_size.QuadPart;
+#else
+		file_desc = open(path, O_RDONLY);
+		if (file_desc < 0)
+		{
+			return false;
+		}
+
+		struct stat file_stat;
+		if (fstat(file_desc, &file_stat) != 0 || file_stat.st_size <= 0)
+		{
+			return false;
+		}
+
+		void *view = mmap(nullptr, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file_desc, 0);
+		if (view == MAP_FAILED)
+		{
+			return false;
+		}
+
+		data = (const uint8_t *)view;
+		size = (size_t)file_stat.st_size;
+#endif
+
+		mapped = true;
+		return true;
+	}
+
+	bool Read(const char *path)
+	{
+		FILE *file_ptr = fopen(path, "rb");
+		if (file_ptr == nullptr)
+		{
+			return false;
+		}
+
+		fseek(file_ptr, 0, SEEK_END);
+		long file_size = ftell(file_ptr);
+		fseek(file_ptr, 0, SEEK_SET);
+
+		if (file_size > 0)
+		{
+			buffer.resize(file_size);
+			buffer.resize(fread(buffer.data(), 1, buffer.size(), file_ptr));
+		}
+
+		fclose(file_ptr);
+
+		data = buffer.data();
+		size = buffer.size();
+		return (size > 0);
+	}
+
+	bool Open(const char *path, bool use_mmap)
+	{
+		Close();
+
+		if (use_mmap == true)
+		{
+			if (Map(path) == true)
+			{
+				return true;
+			}
+
+			printf("Cannot memory-map file, falling back to reading it: %s\n", path);
+			Close();
+		}
+
+		return Read(path);
+	}
+
+	void Close(void)
+	{
+#if defined(_WIN32)
+		if (mapped == true)
+		{
+			UnmapViewOfFile(data);
+		}
+
+		if (map_handle != nullptr)
+		{
+			CloseHandle(map_handle);
+			map_handle = nullptr;
+		}
+
+		if (file_handle != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file_handle);
+			file_handle = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (mapped == true)
+		{
+			munmap((void *)data, size);
+		}
+
+		if (file_desc >= 0)
+		{
+			close(file_desc);
+			file_desc = -1;
+		}
+#endif
+
+		buffer.clear();
+		buffer.shrink_to_fit();
+
+		data = nullptr;
+		size = 0;
+		mapped = false;
+	}
+
+	std::span<const uint8_t> Bytes(void) const
+	{
+		return std::span<const uint8_t>(data, size);
+	}
+};
+
+class wad_header_c
+{
+public:
+	char type[4];
+	int32_t lump_count;
+	int32_t directory_offset;
+};
+
+class wad_lump_c
+{
+public:
+	int32_t offset;
+	int32_t size;
+	char name[8];
+
+	// Packs a lump name into an integer, upper-cased and zero-padded,
+	// so that names can be compared and hashed in a single operation.
+	static constexpr uint64_t make_key(const char *str, size_t max_len = 8)
+	{
+		uint64_t key = 0;
+
+		for (size_t i = 0; i < 8 && i < max_len && str[i] != '\0'; ++i)
+		{
+			uint8_t c = (uint8_t)str[i];
+			if (c >= 'a' && c <= 'z')
+			{
+				c -= ('a' - 'A');
+			}
+
+			key |= ((uint64_t)c << (i * 8));
+		}
+
+		return key;
+	}
+
+	uint64_t key(void) const
+	{
+		return make_key(name, 8);
+	}
+};
+
+class wad_namespace_c
+{
+public:
+	// Lump index ranges between each X_START / X_END pair, exclusive of the markers.
+	std::vector<std::pair<int, int>> ranges;
+	std::unordered_map<uint64_t, int> lookup;
+};
+
+class wad_c
+{
+public:
+	bool valid;
+	std::string path;
+	file_mapping_c file;
+	wad_header_c header;
+	std::vector<wad_lump_c> directory;
+
+	// Lumps that don't sit on a suitable boundary for their element type
+	// get copied here once, so that spans handed out are always aligned.
+	std::mutex realigned_mutex;
+	std::list<std::vector<uint8_t>> realigned_lumps;
+
+	std::unordered_map<uint64_t, int> lump_lookup;
+	std::unordered_map<uint64_t, wad_namespace_c> namespaces;
+
+	// Marker lumps that start a map, in directory order.
+	std::vector<int> map_markers;
+
+	wad_c(const char *wad_path, bool use_mmap = true) : valid(false), path(wad_path)
+	{
+		printf("Attempting to open file: %s\n", wad_path);
+		if (file.Open(wad_path, use_mmap) == false)
+		{
+			printf("Cannot open file: %s\n", wad_path);
+			return;
+		}
+
+		if (file.size < sizeof(header))
+		{
+			printf("File is not a WAD\n");
+			return;
+		}
+
+		memcpy(&header, file.data, sizeof(header));
+		if (strncmp(header.type, "PWAD", 4) != 0
+			&& strncmp(header.type, "IWAD", 4) != 0)
+		{
+			printf("File is not a WAD\n");
+			return;
+		}
+
+		if (header.lump_count <= 0)
+		{
+			printf("File has no lumps\n");
+			return;
+		}
+
+		if (header.directory_offset < 0
+			|| (size_t)header.directory_offset + ((size_t)header.lump_count * sizeof(wad_lump_c)) > file.size)
+		{
+			printf("WAD directory is out of bounds\n");
+			return;
+		}
+
+		directory.resize(header.lump_count);
+		memcpy(directory.data(), file.data + header.directory_offset, header.lump_count * sizeof(wad_lump_c));
+
+		build_index();
+
+		printf("Finished opening WAD (%s)\n", file.mapped ? "memory-mapped" : "buffered");
+		valid = true;
+	}
+
+	wad_c(const wad_c &) = delete;
+	wad_c &operator=(const wad_c &) = delete;
+
+	// Returns the namespace key for a marker lump such as S_START or FF_END,
+	// or 0 if the lump is not a marker. Doubled prefixes (SS_, FF_, PP_)
+	// are treated the same as the single letter ones.
+	static uint64_t marker_namespace(const wad_lump_c &lump, const char *suffix)
+	{
+		size_t suffix_len = strlen(suffix);
+		size_t name_len = strnlen(lump.name, 8);
+
+		if (name_len <= suffix_len || strncmp(lump.name + name_len - suffix_len, suffix, suffix_len) != 0)
+		{
+			return 0;
+		}
+
+		size_t prefix_len = name_len - suffix_len;
+		if (prefix_len == 2 && toupper((unsigned char)lump.name[0]) == toupper((unsigned char)lump.name[1]))
+		{
+			prefix_len = 1;
+		}
+
+		return wad_lump_c::make_key(lump.name, prefix_len);
+	}
+
+	void build_index(void)
+	{
+		lump_lookup.clear();
+		namespaces.clear();
+		map_markers.clear();
+		lump_lookup.reserve(directory.size());
+
+		uint64_t open_namespace = 0;
+		int open_start = 0;
+
+		for (int i = 0, len = (int)directory.size(); i < len; ++i)
+		{
+			const auto &lump = directory[i];
+			const uint64_t key = lump.key();
+
+			// Later lumps replace earlier ones of the same name.
+			lump_lookup[key] = i;
+
+			uint64_t start_ns = marker_namespace(lump, "_START");
+			if (start_ns != 0)
+			{
+				open_namespace = start_ns;
+				open_start = i + 1;
+				continue;
+			}
+
+			uint64_t end_ns = marker_namespace(lump, "_END");
+			if (end_ns != 0)
+			{
+				if (end_ns == open_namespace)
+				{
+					namespaces[open_namespace].ranges.emplace_back(open_start, i);
+				}
+
+				open_namespace = 0;
+				continue;
+			}
+
+			if (open_namespace != 0)
+			{
+				namespaces[open_namespace].lookup[key] = i;
+			}
+		}
+
+		for (int i = 0, len = (int)directory.size() - 1; i < len; ++i)
+		{
+			// A map is any marker followed by THINGS that isn't overridden by a later copy
+			if (directory[i + 1].key() == wad_lump_c::make_key("THINGS")
+				&& lump_lookup[directory[i].key()] == i)
+			{
+				map_markers.push_back(i);
+			}
+		}
+	}
+
+	std::string lump_name(int index) const
+	{
+		const auto &lump = directory[index];
+		return std::string(lump.name, strnlen(lump.name, 8));
+	}
+
+	std::vector<std::string> map_names(void) const
+	{
+		std::vector<std::string> names;
+		names.reserve(map_markers.size());
+
+		for (int marker : map_markers)
+		{
+			names.push_back(lump_name(marker));
+		}
+
+		return names;
+	}
+
+	int find_lump(const char *lump_name) const
+	{
+		auto it = lump_lookup.find(wad_lump_c::make_key(lump_name));
+		return (it != lump_lookup.end()) ? it->second : -1;
+	}
+
+	// Looks up a lump only between the given namespace's markers,
+	// e.g. find_lump("RINGA0", "S") for a sprite.
+	int find_lump(const char *lump_name, const char *namespace_name) const
+	{
+		auto ns = namespaces.find(wad_lump_c::make_key(namespace_name));
+		if (ns == namespaces.end())
+		{
+			return -1;
+		}
+
+		auto it = ns->second.lookup.find(wad_lump_c::make_key(lump_name));
+		return (it != ns->second.lookup.end()) ? it->second : -1;
+	}
+
+	template<typename T>
+		std::span<const T> lump_as_span(const wad_lump_c &lump)
+	{
+		if (lump.offset < 0 || lump.size < 0
+			|| (size_t)lump.offset + (size_t)lump.size > file.size)
+		{
+			printf("Lump %.8s is out of bounds\n", lump.name);
+			return std::span<const T>();
+		}
+
+		const uint8_t *lump_data = file.data + lump.offset;
+		auto count = lump.size / sizeof(T);
+
+		if (((uintptr_t)lump_data % alignof(T)) != 0)
+		{
+			std::lock_guard<std::mutex> lock(realigned_mutex);
+			auto &copy = realigned_lumps.emplace_back(lump_data, lump_data + (count * sizeof(T)));
+			lump_data = copy.data();
+		}
+
+		return std::span<const T>((const T *)lump_data, count);
+	}
+};
+
+struct map_thing_s
+{
+	int16_t x;
+	int16_t y;
+	int16_t angle;
+	int16_t doomednum;
+	int16_t flags;
+};
+
+// Ids into other lumps are unsigned, so big maps can use all 65535 of them
+struct map_linedef_s
+{
+	static constexpr uint16_t NO_SIDEDEF = 0xFFFF;
+
+	uint16_t vertex_id_a;
+	uint16_t vertex_id_b;
+	int16_t flags;
+	int16_t action;
+	int16_t tag;
+	uint16_t side_id_front;
+	uint16_t side_id_back;
+};
+
+struct map_sidedef_s
+{
+	int16_t x_offset;
+	int16_t y_offset;
+	char texture_upper[8];
+	char texture_lower[8];
+	char texture_middle[8];
+	uint16_t sector_id;
+};
+
+struct map_vertex_s
+{
+	int16_t x;
+	int16_t y;
+};
+
+/*
+struct map_seg_s
+{
+	uint16_t vertex_id_a;
+	uint16_t vertex_id_b;
+	int16_t angle;
+	uint16_t linedef_id;
+	int16_t side;
+	int16_t offset;
+};
+
+struct map_subsector_s
+{
+	int16_t seg_count;
+	int16_t seg_id;
+};
+
+struct map_node_s
+{
+	int16_t partition_x;
+	int16_t partition_y;
+	int16_t partition_x_delta;
+	int16_t partition_y_delta;
+	int16_t bbox_right[4];
+	int16_t bbox_left[4];
+	int16_t child_right;
+	int16_t child_left;
+};
+*/
+
+struct map_sector_s
+{
+	int16_t floor_height;
+	int16_t ceiling_height;
+	char floor_texture[8];
+	char ceiling_texture[8];
+	int16_t light;
+	int16_t special;
+	int16_t tag;
+};
+
+// What SRB2's thing types are, for drawing them and for picking out locations.
+// Looking one up is a plain array index by doomednum; the table behind it is
+// worked out at compile time from the ranges below.
+class thing_types_c
+{
+public:
+	enum category_e : uint8_t
+	{
+		CATEGORY_OTHER,
+		CATEGORY_PLAYER_START,
+		CATEGORY_ENEMY,
+		CATEGORY_BOSS,
+		CATEGORY_RING,
+		CATEGORY_MONITOR,
+		CATEGORY_EMBLEM,
+		CATEGORY_TOKEN,
+		CATEGORY_EMERALD,
+		CATEGORY_SPRING,
+		CATEGORY_STARPOST,
+		CATEGORY_SIGNPOST,
+		CATEGORY_COUNT
+	};
+
+	enum flags_e : uint8_t
+	{
+		// The player picks it up
+		FLAG_COLLECTIBLE = 1 << 0,
+
+		// Worth enough to hold a randomized item
+		FLAG_LOCATION = 1 << 1,
+	};
+
+	struct category_s
+	{
+		const char *name;
+		ImU32 color;
+		float radius;
+		uint8_t flags;
+	};
+
+	static constexpr category_s CATEGORIES[CATEGORY_COUNT] = {
+		{ "other", IM_COL32(200, 200, 200, 200), 8.0f, 0 },
+		{ "player_start", IM_COL32(80, 220, 120, 220), 16.0f, 0 },
+		{ "enemy", IM_COL32(230, 70, 70, 220), 24.0f, 0 },
+		{ "boss", IM_COL32(255, 40, 160, 230), 32.0f, 0 },
+		{ "ring", IM_COL32(255, 215, 0, 200), 16.0f, FLAG_COLLECTIBLE },
+		{ "monitor", IM_COL32(90, 190, 255, 230), 18.0f, FLAG_COLLECTIBLE | FLAG_LOCATION },
+		{ "emblem", IM_COL32(255, 140, 0, 240), 16.0f, FLAG_COLLECTIBLE | FLAG_LOCATION },
+		{ "token", IM_COL32(200, 120, 255, 240), 16.0f, FLAG_COLLECTIBLE | FLAG_LOCATION },
+		{ "emerald", IM_COL32(60, 255, 200, 240), 16.0f, FLAG_COLLECTIBLE | FLAG_LOCATION },
+		{ "spring", IM_COL32(240, 120, 60, 200), 20.0f, 0 },
+		{ "starpost", IM_COL32(120, 120, 255, 220), 32.0f, 0 },
+		{ "signpost", IM_COL32(255, 255, 255, 240), 32.0f, 0 },
+	};
+
+	// Binary maps keep extra info in the top four bits of the type
+	static constexpr int TYPE_COUNT = 4096;
+
+	struct range_s
+	{
+		int first, last;
+		category_e category;
+	};
+
+	static constexpr range_s RANGES[] = {
+		{ 1, 35, CATEGORY_PLAYER_START }, // Player, match and team starts
+		{ 100, 139, CATEGORY_ENEMY },
+		{ 200, 209, CATEGORY_BOSS },
+		{ 300, 309, CATEGORY_RING }, // Rings, weapon rings and team rings
+		{ 312, 312, CATEGORY_TOKEN },
+		{ 313, 319, CATEGORY_EMERALD },
+		{ 322, 322, CATEGORY_EMBLEM },
+		{ 400, 449, CATEGORY_MONITOR },
+		{ 501, 501, CATEGORY_SIGNPOST },
+		{ 502, 502, CATEGORY_STARPOST },
+		{ 550, 559, CATEGORY_SPRING },
+		{ 600, 609, CATEGORY_RING }, // Ring and sphere formations
+		{ 1706, 1706, CATEGORY_RING }, // Blue sphere
+		{ 1800, 1800, CATEGORY_RING }, // Coin
+	};
+
+	struct table_s
+	{
+		category_e categories[TYPE_COUNT];
+	};
+
+	static constexpr table_s BuildTable(void)
+	{
+		table_s table = {};
+
+		for (const auto &range : RANGES)
+		{
+			for (int type = range.first; type <= range.last; ++type)
+			{
+				table.categories[type] = range.category;
+			}
+		}
+
+		return table;
+	}
+
+	static const table_s &Table(void)
+	{
+		static constexpr table_s table = BuildTable();
+		return table;
+	}
+
+	static category_e Category(int16_t doomednum)
+	{
+		return Table().categories[(uint16_t)doomednum & (TYPE_COUNT - 1)];
+	}
+
+	static const category_s &Info(category_e category)
+	{
+		return CATEGORIES[category];
+	}
+
+	static constexpr float MaxRadius(void)
+	{
+		float radius = 0.0f;
+		for (const auto &category : CATEGORIES)
+		{
+			radius = std::max(radius, category.radius);
+		}
+
+		return radius;
+	}
+};
+
+// The map data that geometry passes read over and over, stored as one array per
+// field instead of one struct per line or thing. Line endpoints are resolved from
+// their vertices up front, and each line's bounding box is kept alongside, so
+// nothing has to chase vertex ids and a pass over any one field is a straight
+// walk through memory.
+class map_columns_c
+{
+public:
+	std::vector<float> line_x0, line_y0;
+	std::vector<float> line_x1, line_y1;
+	std::vector<float> line_min_x, line_min_y;
+	std::vector<float> line_max_x, line_max_y;
+
+	std::vector<float> thing_x, thing_y;
+	std::vector<thing_types_c::category_e> thing_category;
+
+	void Build(std::span<const map_linedef_s> linedefs, std::span<const map_vertex_s> vertices, std::span<const map_thing_s> things)
+	{
+		const size_t line_count = linedefs.size();
+
+		for (auto *column : { &line_x0, &line_y0, &line_x1, &line_y1, &line_min_x, &line_min_y, &line_max_x, &line_max_y })
+		{
+			column->resize(line_count);
+		}
+
+		for (size_t i = 0; i < line_count; ++i)
+		{
+			const auto &vertex_a = vertices[linedefs[i].vertex_id_a];
+			const auto &vertex_b = vertices[linedefs[i].vertex_id_b];
+
+			line_x0[i] = vertex_a.x;
+			line_y0[i] = vertex_a.y;
+			line_x1[i] = vertex_b.x;
+			line_y1[i] = vertex_b.y;
+		}
+
+		// Separate pass, so it runs over the columns alone
+		for (size_t i = 0; i < line_count; ++i)
+		{
+			line_min_x[i] = std::min(line_x0[i], line_x1[i]);
+			line_min_y[i] = std::min(line_y0[i], line_y1[i]);
+			line_max_x[i] = std::max(line_x0[i], line_x1[i]);
+			line_max_y[i] = std::max(line_y0[i], line_y1[i]);
+		}
+
+		thing_x.resize(things.size());
+		thing_y.resize(things.size());
+		thing_category.resize(things.size());
+
+		for (size_t i = 0; i < things.size(); ++i)
+		{
+			thing_x[i] = things[i].x;
+			thing_y[i] = things[i].y;
+			thing_category[i] = thing_types_c::Category(things[i].doomednum);
+		}
+	}
+
+	int LineCount(void) const
+	{
+		return (int)line_x0.size();
+	}
+
+	int ThingCount(void) const
+	{
+		return (int)thing_x.size();
+	}
+
+	ImVec2 LineStart(int line_id) const
+	{
+		return ImVec2(line_x0[line_id], line_y0[line_id]);
+	}
+
+	ImVec2 LineEnd(int line_id) const
+	{
+		return ImVec2(line_x1[line_id], line_y1[line_id]);
+	}
+
+	ImVec2 Thing(int thing_id) const
+	{
+		return ImVec2(thing_x[thing_id], thing_y[thing_id]);
+	}
+
+	bool LineOverlaps(int line_id, float min_x, float min_y, float max_x, float max_y) const
+	{
+		return (line_max_x[line_id] >= min_x && line_min_x[line_id] <= max_x
+			&& line_max_y[line_id] >= min_y && line_min_y[line_id] <= max_y);
+	}
+};
+
+// A map's things grouped by category, CSR style: offsets[category] .. offsets[category + 1]
+// index into thing_ids, which stay in map order within each category. Passes that only
+// care about emblems or monitors walk those and skip everything else.
+class thing_category_index_c
+{
+public:
+	uint32_t offsets[thing_types_c::CATEGORY_COUNT + 1];
+	std::vector<uint32_t> thing_ids;
+
+	thing_category_index_c() : offsets{}
+	{
+	}
+
+	void Build(const map_columns_c &columns)
+	{
+		const int thing_count = columns.ThingCount();
+
+		// Counting sort; stable, so ids come out ascending per category
+		uint32_t counts[thing_types_c::CATEGORY_COUNT] = {};
+		for (int i = 0; i < thing_count; ++i)
+		{
+			counts[columns.thing_category[i]]++;
+		}
+
+		offsets[0] = 0;
+		for (int category = 0; category < thing_types_c::CATEGORY_COUNT; ++category)
+		{
+			offsets[category + 1] = offsets[category] + counts[category];
+		}
+
+		uint32_t cursor[thing_types_c::CATEGORY_COUNT];
+		std::copy(offsets, offsets + thing_types_c::CATEGORY_COUNT, cursor);
+
+		thing_ids.resize(thing_count);
+		for (int i = 0; i < thing_count; ++i)
+		{
+			thing_ids[cursor[columns.thing_category[i]]++] = i;
+		}
+	}
+
+	std::span<const uint32_t> Things(thing_types_c::category_e category) const
+	{
+		return std::span<const uint32_t>(thing_ids.data() + offsets[category], offsets[category + 1] - offsets[category]);
+	}
+
+	// Every thing whose category has all of the given flags. The matching categories are
+	// gathered one after another, then put back in map order so callers see things in the
+	// same order as a plain walk over the map would give them.
+	std::vector<uint32_t> ThingsWithFlags(uint8_t flags) const
+	{
+		std::vector<uint32_t> ids;
+
+		for (int category = 0; category < thing_types_c::CATEGORY_COUNT; ++category)
+		{
+			if ((thing_types_c::CATEGORIES[category].flags & flags) == flags)
+			{
+				const auto things = Things((thing_types_c::category_e)category);
+				ids.insert(ids.end(), things.begin(), things.end());
+			}
+		}
+
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+};
+
+// Uniform grid over a map's linedefs and things, in map units.
+// Cells are stored CSR style: offsets[cell] .. offsets[cell + 1] index into ids.
+class map_grid_c
+{
+public:
+	static constexpr int CELL_SIZE = 256;
+
+	int origin_x, origin_y;
+	int columns, rows;
+
+	std::vector<uint32_t> line_offsets;
+	std::vector<uint32_t> line_ids;
+
+	std::vector<uint32_t> thing_offsets;
+	std::vector<uint32_t> thing_ids;
+
+	map_grid_c() : origin_x(0), origin_y(0), columns(0), rows(0)
+	{
+	}
+
+	int CellX(float x) const
+	{
+		return std::clamp((int)floorf((x - origin_x) / CELL_SIZE), 0, columns - 1);
+	}
+
+	int CellY(float y) const
+	{
+		return std::clamp((int)floorf((y - origin_y) / CELL_SIZE), 0, rows - 1);
+	}
+
+	void Build(const map_columns_c &map_columns)
+	{
+		int min_x = INT16_MAX, min_y = INT16_MAX;
+		int max_x = INT16_MIN, max_y = INT16_MIN;
+
+		for (int i = 0, len = map_columns.LineCount(); i < len; ++i)
+		{
+			min_x = std::min(min_x, (int)map_columns.line_min_x[i]);
+			min_y = std::min(min_y, (int)map_columns.line_min_y[i]);
+			max_x = std::max(max_x, (int)map_columns.line_max_x[i]);
+			max_y = std::max(max_y, (int)map_columns.line_max_y[i]);
+		}
+
+		for (int i = 0, len = map_columns.ThingCount(); i < len; ++i)
+		{
+			min_x = std::min(min_x, (int)map_columns.thing_x[i]);
+			min_y = std::min(min_y, (int)map_columns.thing_y[i]);
+			max_x = std::max(max_x, (int)map_columns.thing_x[i]);
+			max_y = std::max(max_y, (int)map_columns.thing_y[i]);
+		}
+
+		if (min_x > max_x)
+		{
+			min_x = max_x = 0;
+			min_y = max_y = 0;
+		}
+
+		origin_x = min_x;
+		origin_y = min_y;
+		columns = ((max_x - min_x) / CELL_SIZE) + 1;
+		rows = ((max_y - min_y) / CELL_SIZE) + 1;
+
+		const int cell_count = columns * rows;
+
+		// Lines go into every cell their bounding box touches.
+		// Count first, then fill, so each list is one contiguous block.
+		line_offsets.assign(cell_count + 1, 0);
+
+		auto for_line_cells = [&](uint32_t line_id, auto &&func)
+		{
+			int cell_x0 = CellX(map_columns.line_min_x[line_id]);
+			int cell_x1 = CellX(map_columns.line_max_x[line_id]);
+			int cell_y0 = CellY(map_columns.line_min_y[line_id]);
+			int cell_y1 = CellY(map_columns.line_max_y[line_id]);
+
+			for (int cell_y = cell_y0; cell_y <= cell_y1; ++cell_y)
+			{
+				for (int cell_x = cell_x0; cell_x <= cell_x1; ++cell_x)
+				{
+					func((cell_y * columns) + cell_x);
+				}
+			}
+		};
+
+		const uint32_t line_count = (uint32_t)map_columns.LineCount();
+		const uint32_t thing_count = (uint32_t)map_columns.ThingCount();
+
+		for (uint32_t i = 0; i < line_count; ++i)
+		{
+			for_line_cells(i, [&](int cell) { line_offsets[cell + 1]++; });
+		}
+
+		for (int i = 0; i < cell_count; ++i)
+		{
+			line_offsets[i + 1] += line_offsets[i];
+		}
+
+		line_ids.resize(line_offsets[cell_count]);
+		std::vector<uint32_t> cursor(line_offsets.begin(), line_offsets.end() - 1);
+
+		for (uint32_t i = 0; i < line_count; ++i)
+		{
+			for_line_cells(i, [&](int cell) { line_ids[cursor[cell]++] = i; });
+		}
+
+		// Things are points, so each one lives in exactly one cell.
+		thing_offsets.assign(cell_count + 1, 0);
+
+		for (uint32_t i = 0; i < thing_count; ++i)
+		{
+			thing_offsets[ThingCell(map_columns, i) + 1]++;
+		}
+
+		for (int i = 0; i < cell_count; ++i)
+		{
+			thing_offsets[i + 1] += thing_offsets[i];
+		}
+
+		thing_ids.resize(thing_offsets[cell_count]);
+		cursor.assign(thing_offsets.begin(), thing_offsets.end() - 1);
+
+		for (uint32_t i = 0; i < thing_count; ++i)
+		{
+			thing_ids[cursor[ThingCell(map_columns, i)]++] = i;
+		}
+	}
+
+	int ThingCell(const map_columns_c &map_columns, uint32_t thing_id) const
+	{
+		return (CellY(map_columns.thing_y[thing_id]) * columns) + CellX(map_columns.thing_x[thing_id]);
+	}
+
+	// Calls func(line_id) once for each linedef whose bounding box overlaps the rectangle.
+	template<typename F>
+		void ForEachLine(const map_columns_c &map_columns,
+			float min_x, float min_y, float max_x, float max_y, F &&func) const
+	{
+		if (columns <= 0 || rows <= 0)
+		{
+			return;
+		}
+
+		const int cell_x0 = CellX(min_x), cell_x1 = CellX(max_x);
+		const int cell_y0 = CellY(min_y), cell_y1 = CellY(max_y);
+
+		for (int cell_y = cell_y0; cell_y <= cell_y1; ++cell_y)
+		{
+			for (int cell_x = cell_x0; cell_x <= cell_x1; ++cell_x)
+			{
+				const int cell = (cell_y * columns) + cell_x;
+
+				for (uint32_t i = line_offsets[cell]; i < line_offsets[cell + 1]; ++i)
+				{
+					const uint32_t line_id = line_ids[i];
+
+					// A line is listed in every cell of its bounding box, so only
+					// report it from the first of those cells inside the query.
+					if (cell_x != std::max(cell_x0, CellX(map_columns.line_min_x[line_id]))
+						|| cell_y != std::max(cell_y0, CellY(map_columns.line_min_y[line_id])))
+					{
+						continue;
+					}
+
+					if (map_columns.LineOverlaps(line_id, min_x, min_y, max_x, max_y) == false)
+					{
+						continue;
+					}
+
+					func(line_id);
+				}
+			}
+		}
+	}
+
+	// Calls func(thing_id) for each thing inside the rectangle.
+	template<typename F>
+		void ForEachThing(const map_columns_c &map_columns,
+			float min_x, float min_y, float max_x, float max_y, F &&func) const
+	{
+		if (columns <= 0 || rows <= 0)
+		{
+			return;
+		}
+
+		const int cell_x0 = CellX(min_x), cell_x1 = CellX(max_x);
+		const int cell_y0 = CellY(min_y), cell_y1 = CellY(max_y);
+
+		for (int cell_y = cell_y0; cell_y <= cell_y1; ++cell_y)
+		{
+			for (int cell_x = cell_x0; cell_x <= cell_x1; ++cell_x)
+			{
+				const int cell = (cell_y * columns) + cell_x;
+
+				for (uint32_t i = thing_offsets[cell]; i < thing_offsets[cell + 1]; ++i)
+				{
+					const uint32_t thing_id = thing_ids[i];
+					const float x = map_columns.thing_x[thing_id];
+					const float y = map_columns.thing_y[thing_id];
+
+					if (x < min_x || x > max_x || y < min_y || y > max_y)
+					{
+						continue;
+					}
+
+					func(thing_id);
+				}
+			}
+		}
+	}
+};
+
+struct sector_edge_s
+{
+	int32_t sector_id;
+	int32_t linedef_id;
+	int16_t flags;
+	int16_t action;
+	int16_t tag;
+	int32_t floor_step;
+	int32_t ceiling_step;
+};
+
+// Which sectors connect to which through two-sided linedefs, stored CSR style:
+// the edges leaving sector N are edges[offsets[N]] up to edges[offsets[N + 1]].
+// Steps are measured from the sector the edge leaves to the one it enters.
+class sector_graph_c
+{
+public:
+	std::vector<uint32_t> offsets;
+	std::vector<sector_edge_s> edges;
+
+	void Build(std::span<const map_linedef_s> linedefs, std::span<const map_sidedef_s> sidedefs, std::span<const map_sector_s> sectors)
+	{
+		const int sector_count = (int)sectors.size();
+		offsets.assign(sector_count + 1, 0);
+
+		auto line_sectors = [&](const map_linedef_s &line, int &front, int &back)
+		{
+			front = (line.side_id_front != map_linedef_s::NO_SIDEDEF) ? sidedefs[line.side_id_front].sector_id : -1;
+			back = (line.side_id_back != map_linedef_s::NO_SIDEDEF) ? sidedefs[line.side_id_back].sector_id : -1;
+			return (front >= 0 && back >= 0 && front != back);
+		};
+
+		for (const auto &line : linedefs)
+		{
+			int front, back;
+			if (line_sectors(line, front, back) == true)
+			{
+				offsets[front + 1]++;
+				offsets[back + 1]++;
+			}
+		}
+
+		for (int i = 0; i < sector_count; ++i)
+		{
+			offsets[i + 1] += offsets[i];
+		}
+
+		edges.resize(offsets[sector_count]);
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+
+		for (int i = 0, len = (int)linedefs.size(); i < len; ++i)
+		{
+			const auto &line = linedefs[i];
+
+			int front, back;
+			if (line_sectors(line, front, back) == false)
+			{
+				continue;
+			}
+
+			const auto &front_sector = sectors[front];
+			const auto &back_sector = sectors[back];
+
+			const int32_t floor_step = (int32_t)back_sector.floor_height - front_sector.floor_height;
+			const int32_t ceiling_step = (int32_t)back_sector.ceiling_height - front_sector.ceiling_height;
+
+			edges[cursor[front]++] = { back, i, line.flags, line.action, line.tag, floor_step, ceiling_step };
+			edges[cursor[back]++] = { front, i, line.flags, line.action, line.tag, -floor_step, -ceiling_step };
+		}
+	}
+
+	std::span<const sector_edge_s> Neighbours(int sector_id) const
+	{
+		return std::span<const sector_edge_s>(edges.data() + offsets[sector_id], edges.data() + offsets[sector_id + 1]);
+	}
+};
+
+class map_load_status_c
+{
+public:
+	std::stop_token stop;
+	std::atomic<float> progress;
+
+	map_load_status_c() : progress(0.0f)
+	{
+	}
+
+	map_load_status_c(std::stop_token stop_token) : stop(stop_token), progress(0.0f)
+	{
+	}
+
+	// Reports how far along the load is, and returns false if it should be abandoned.
+	bool Step(float fraction)
+	{
+		progress = fraction;
+		return (stop.stop_requested() == false);
+	}
+};
+
+class map_c
+{
+public:
+	std::atomic_bool loaded;
+	std::string name;
+
+	// Lump data is viewed directly from the WAD, so hold onto it for as long as the map lives.
+	std::shared_ptr<wad_c> wad;
+
+	std::span<const map_thing_s> things;
+	std::span<const map_linedef_s> linedefs;
+	std::span<const map_sidedef_s> sidedefs;
+	std::span<const map_vertex_s> vertices;
+	std::span<const map_sector_s> sectors;
+
+	map_columns_c columns;
+	thing_category_index_c thing_categories;
+	map_grid_c grid;
+	sector_graph_c sector_graph;
+
+	static constexpr int VALIDATE_CHUNK = 4096;
+
+	map_c(std::shared_ptr<wad_c> wad_ptr, const char *map_name, map_load_status_c *status = nullptr) : loaded(false), name(map_name), wad(wad_ptr)
+	{
+		map_load_status_c local_status;
+		if (status == nullptr)
+		{
+			status = &local_status;
+		}
+
+		if (wad == nullptr || wad->valid == false)
+		{
+			printf("Tried to load map from invalid WAD\n");
+			return;
+		}
+
+		int i = wad->find_lump(map_name);
+		if (i < 0)
+		{
+			printf("No map lump labelled %s\n", map_name);
+			return;
+		}
+
+		for (int j = i + 1, len = (int)wad->directory.size(); j < len; ++j)
+		{
+			const auto &resource_lump = wad->directory[j];
+			bool is_map_lump = true;
+
+			switch (resource_lump.key())
+			{
+				case wad_lump_c::make_key("THINGS"):
+				{
+					things = wad->lump_as_span<map_thing_s>(resource_lump);
+					break;
+				}
+				case wad_lump_c::make_key("LINEDEFS"):
+				{
+					linedefs = wad->lump_as_span<map_linedef_s>(resource_lump);
+					break;
+				}
+				case wad_lump_c::make_key("SIDEDEFS"):
+				{
+					sidedefs = wad->lump_as_span<map_sidedef_s>(resource_lump);
+					break;
+				}
+				case wad_lump_c::make_key("VERTEXES"):
+				{
+					vertices = wad->lump_as_span<map_vertex_s>(resource_lump);
+					break;
+				}
+				case wad_lump_c::make_key("SECTORS"):
+				{
+					sectors = wad->lump_as_span<map_sector_s>(resource_lump);
+					break;
+				}
+				case wad_lump_c::make_key("SEGS"):
+				case wad_lump_c::make_key("SSECTORS"):
+				case wad_lump_c::make_key("NODES"):
+				case wad_lump_c::make_key("REJECT"):
+				case wad_lump_c::make_key("BLOCKMAP"):
+				{
+					break;
+				}
+				default:
+				{
+					// Ran into the next map, or something unrelated
+					is_map_lump = false;
+					break;
+				}
+			}
+
+			if (is_map_lump == false)
+			{
+				break;
+			}
+		}
+
+		if (status->Step(0.1f) == false || Validate(status) == false)
+		{
+			return;
+		}
+
+		if (status->Step(0.8f) == false)
+		{
+			return;
+		}
+
+		columns.Build(linedefs, vertices, things);
+		thing_categories.Build(columns);
+		grid.Build(columns);
+
+		if (status->Step(0.9f) == false)
+		{
+			return;
+		}
+
+		sector_graph.Build(linedefs, sidedefs, sectors);
+
+		status->Step(1.0f);
+		printf("Map %s successfully loaded\n", map_name);
+		loaded = true;
+	}
+
+	// Checks that every index in the map data refers to something that exists,
+	// so that nothing downstream has to bounds check them again.
+	bool Validate(map_load_status_c *status)
+	{
+		const int vertex_count = (int)vertices.size();
+		const int sidedef_count = (int)sidedefs.size();
+		const int sector_count = (int)sectors.size();
+
+		for (int i = 0, len = (int)linedefs.size(); i < len; ++i)
+		{
+			if ((i % VALIDATE_CHUNK) == 0 && status->Step(0.1f + 0.6f * ((float)i / len)) == false)
+			{
+				return false;
+			}
+
+			const auto &line = linedefs[i];
+
+			if (line.vertex_id_a >= vertex_count || line.vertex_id_b >= vertex_count)
+			{
+				printf("Linedef %d references a missing vertex\n", i);
+				return false;
+			}
+
+			if ((line.side_id_front != map_linedef_s::NO_SIDEDEF && line.side_id_front >= sidedef_count)
+				|| (line.side_id_back != map_linedef_s::NO_SIDEDEF && line.side_id_back >= sidedef_count))
+			{
+				printf("Linedef %d references a missing sidedef\n", i);
+				return false;
+			}
+		}
+
+		for (int i = 0, len = (int)sidedefs.size(); i < len; ++i)
+		{
+			if ((i % VALIDATE_CHUNK) == 0 && status->Step(0.7f + 0.1f * ((float)i / len)) == false)
+			{
+				return false;
+			}
+
+			if (sidedefs[i].sector_id >= sector_count)
+			{
+				printf("Sidedef %d references a missing sector\n", i);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Each sector's bounding box, from the lines bordering it.
+	// Sectors without any lines are left with min above max.
+	void SectorBounds(std::vector<ImVec2> &mins, std::vector<ImVec2> &maxs) const
+	{
+		mins.assign(sectors.size(), ImVec2(FLT_MAX, FLT_MAX));
+		maxs.assign(sectors.size(), ImVec2(-FLT_MAX, -FLT_MAX));
+
+		for (int i = 0, len = (int)linedefs.size(); i < len; ++i)
+		{
+			const auto &line = linedefs[i];
+
+			for (uint16_t side_id : { line.side_id_front, line.side_id_back })
+			{
+				if (side_id == map_linedef_s::NO_SIDEDEF)
+				{
+					continue;
+				}
+
+				const int sector_id = sidedefs[side_id].sector_id;
+				mins[sector_id] = ImVec2(std::min(mins[sector_id].x, columns.line_min_x[i]), std::min(mins[sector_id].y, columns.line_min_y[i]));
+				maxs[sector_id] = ImVec2(std::max(maxs[sector_id].x, columns.line_max_x[i]), std::max(maxs[sector_id].y, columns.line_max_y[i]));
+			}
+		}
+	}
+
+	// Middle of each sector's bounding box, from the lines bordering it.
+	std::vector<ImVec2> SectorCenters(void) const
+	{
+		std::vector<ImVec2> mins, maxs;
+		SectorBounds(mins, maxs);
+
+		std::vector<ImVec2> centers(sectors.size());
+		for (size_t i = 0; i < centers.size(); ++i)
+		{
+			centers[i] = (mins[i].x <= maxs[i].x)
+				? ImVec2((mins[i].x + maxs[i].x) * 0.5f, (mins[i].y + maxs[i].y) * 0.5f)
+				: ImVec2(FLT_MAX, FLT_MAX);
+		}
+
+		return centers;
+	}
+
+	// Decodes every map in the WAD at once across the thread pool.
+	// All of them share the WAD's single read-only mapping.
+	static std::vector<std::shared_ptr<map_c>> LoadAll(std::shared_ptr<wad_c> wad, thread_pool_c &pool = thread_pool_c::Shared())
+	{
+		std::vector<std::shared_ptr<map_c>> maps;
+		if (wad == nullptr || wad->valid == false)
+		{
+			return maps;
+		}
+
+		const std::vector<std::string> names = wad->map_names();
+		maps.resize(names.size());
+
+		pool.ParallelFor((int)names.size(), [&](int i)
+		{
+			maps[i] = std::make_shared<map_c>(wad, names[i].c_str());
+		});
+
+		// Leave out anything that failed to load
+		std::erase_if(maps, [](const std::shared_ptr<map_c> &map) { return map->loaded == false; });
+		return maps;
+	}
+};
+
+class map_loader_c
+{
+public:
+	std::string loading_name;
+	std::atomic_bool busy;
+	std::atomic<std::shared_ptr<map_c>> finished;
+	std::unique_ptr<map_load_status_c> status;
+	std::stop_source stop_source;
+	std::thread worker;
+
+	// Called from the worker thread once a load has finished or failed.
+	std::function<void()> on_finished;
+
+	map_loader_c() : busy(false)
+	{
+	}
+
+	~map_loader_c()
+	{
+		Cancel();
+	}
+
+	void Cancel(void)
+	{
+		stop_source.request_stop();
+
+		if (worker.joinable() == true)
+		{
+			worker.join();
+		}
+
+		busy = false;
+	}
+
+	// Starts loading a map on a worker thread, abandoning any load already in progress.
+	void Start(const std::string &wad_path, const std::string &map_name)
+	{
+		Cancel();
+
+		loading_name = map_name;
+		finished.store(nullptr);
+		busy = true;
+
+		stop_source = std::stop_source();
+		status = std::make_unique<map_load_status_c>(stop_source.get_token());
+
+		worker = std::thread([this, wad_path, map_name, status_ptr = status.get()]()
+		{
+			auto wad = std::make_shared<wad_c>(wad_path.c_str());
+			auto map = std::make_shared<map_c>(wad, map_name.c_str(), status_ptr);
+
+			if (status_ptr->stop.stop_requested() == false && map->loaded == true)
+			{
+				finished.store(map);
+			}
+
+			busy = false;
+
+			if (on_finished)
+			{
+				on_finished();
+			}
+		});
+	}
+
+	float Progress(void) const
+	{
+		return (status != nullptr) ? status->progress.load() : 0.0f;
+	}
+
+	// Hands over the most recently finished map, if there is one.
+	std::shared_ptr<map_c> Poll(void)
+	{
+		return finished.exchange(nullptr);
+	}
+};
+
+#define MAP_GL_FUNCTIONS(X) \
+	X(PFNGLCREATESHADERPROC, glCreateShader) \
+	X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+	X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+	X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+	X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
+	X(PFNGLDELETESHADERPROC, glDeleteShader) \
+	X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+	X(PFNGLATTACHSHADERPROC, glAttachShader) \
+	X(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation) \
+	X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+	X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+	X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
+	X(PFNGLDELETEPROGRAMPROC, glDeleteProgram) \
+	X(PFNGLUSEPROGRAMPROC, glUseProgram) \
+	X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
+	X(PFNGLUNIFORM1FPROC, glUniform1f) \
+	X(PFNGLUNIFORM4FPROC, glUniform4f) \
+	X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+	X(PFNGLBINDBUFFERPROC, glBindBuffer) \
+	X(PFNGLBUFFERDATAPROC, glBufferData) \
+	X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
+	X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
+	X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer)
+
+#if defined(IMGUI_IMPL_OPENGL_ES2)
+#define MAP_GL_VAO_FUNCTIONS(X)
+#else
+#define MAP_GL_VAO_FUNCTIONS(X) \
+	X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays) \
+	X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray) \
+	X(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays)
+#endif
+
+// Draws static map geometry out of vertex buffers that are uploaded once per map.
+// Panning and zooming only change a single transform uniform.
+class map_renderer_c
+{
+public:
+	struct vertex_s
+	{
+		float x, y;
+		ImU32 color;
+
+		// Things only: the radius in map units, and which corner of the thing's
+		// square this is, from -1 to 1. Lines leave them at 0.
+		float size;
+		float corner_x, corner_y;
+	};
+
+	class gl_functions_c
+	{
+	public:
+#define MAP_GL_DECLARE(type, func) type func = nullptr;
+		MAP_GL_FUNCTIONS(MAP_GL_DECLARE)
+		MAP_GL_VAO_FUNCTIONS(MAP_GL_DECLARE)
+#undef MAP_GL_DECLARE
+
+		bool Load(void)
+		{
+#define MAP_GL_LOAD(type, func) \
+			func = (type)SDL_GL_GetProcAddress(#func); \
+			if (func == nullptr) \
+			{ \
+				printf("Missing GL function %s\n", #func); \
+				return false; \
+			}
+
+			MAP_GL_FUNCTIONS(MAP_GL_LOAD)
+			MAP_GL_VAO_FUNCTIONS(MAP_GL_LOAD)
+#undef MAP_GL_LOAD
+			return true;
+		}
+	};
+
+	bool valid;
+	gl_functions_c gl;
+
+	GLuint program;
+	GLint uniform_transform;
+	GLint uniform_pixel_size;
+	GLint uniform_round_points;
+
+	GLuint line_buffer;
+	GLuint thing_buffer;
+	GLuint vertex_array;
+	GLsizei line_vertex_count;
+	GLsizei thing_vertex_count;
+
+	// The map currently in the buffers. Only compared against, never dereferenced.
+	const map_c *uploaded_map;
+
+	// Set up each frame before the draw callback runs.
+	// pixel_size is how many map units one pixel covers.
+	float transform[4];
+	float pixel_size;
+
+	map_renderer_c() : valid(false), program(0), uniform_transform(-1), uniform_pixel_size(-1), uniform_round_points(-1),
+		line_buffer(0), thing_buffer(0), vertex_array(0), line_vertex_count(0), thing_vertex_count(0),
+		uploaded_map(nullptr), transform{1.0f, 1.0f, 0.0f, 0.0f}, pixel_size(1.0f)
+	{
+	}
+
+	GLuint CompileShader(GLenum type, const char *glsl_version, const char *source)
+	{
+		const char *sources[] = { glsl_version, "\n", source };
+
+		GLuint shader = gl.glCreateShader(type);
+		gl.glShaderSource(shader, 3, sources, nullptr);
+		gl.glCompileShader(shader);
+
+		GLint status = 0;
+		gl.glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (status == GL_FALSE)
+		{
+			char log[1024];
+			gl.glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+			printf("Map shader failed to compile: %s\n", log);
+			gl.glDeleteShader(shader);
+			return 0;
+		}
+
+		return shader;
+	}
+
+	bool Init(const char *glsl_version)
+	{
+		if (gl.Load() == false)
+		{
+			return false;
+		}
+
+		static const char *vertex_source =
+			"#if __VERSION__ >= 130\n"
+			"#define ATTRIBUTE in\n"
+			"#define VARYING out\n"
+			"#else\n"
+			"#define ATTRIBUTE attribute\n"
+			"#define VARYING varying\n"
+			"#endif\n"
+			"uniform vec4 u_transform;\n"
+			"uniform float u_pixel_size;\n"
+			"uniform float u_round_points;\n"
+			"ATTRIBUTE vec2 a_position;\n"
+			"ATTRIBUTE vec4 a_color;\n"
+			"ATTRIBUTE float a_size;\n"
+			"ATTRIBUTE vec2 a_corner;\n"
+			"VARYING vec4 v_color;\n"
+			"VARYING vec2 v_corner;\n"
+			"VARYING float v_round;\n"
+			"void main()\n"
+			"{\n"
+			"	float radius = max(a_size, u_pixel_size * 0.5);\n"
+			"	v_color = a_color;\n"
+			"	v_corner = a_corner;\n"
+			"	v_round = (radius > u_pixel_size) ? u_round_points : 0.0;\n"
+			"	gl_Position = vec4(((a_position + (a_corner * radius)) * u_transform.xy) + u_transform.zw, 0.0, 1.0);\n"
+			"}\n";
+
+		static const char *fragment_source =
+			"#if __VERSION__ >= 130\n"
+			"#define VARYING in\n"
+			"out vec4 frag_color;\n"
+			"#define FRAG_COLOR frag_color\n"
+			"#else\n"
+			"precision mediump float;\n"
+			"#define VARYING varying\n"
+			"#define FRAG_COLOR gl_FragColor\n"
+			"#endif\n"
+			"VARYING vec4 v_color;\n"
+			"VARYING vec2 v_corner;\n"
+			"VARYING float v_round;\n"
+			"void main()\n"
+			"{\n"
+			"	if (v_round > 0.5 && dot(v_corner, v_corner) > 1.0)\n"
+			"		discard;\n"
+			"	FRAG_COLOR = v_color;\n"
+			"}\n";
+
+		GLuint vertex_shader = CompileShader(GL_VERTEX_SHADER, glsl_version, vertex_source);
+		GLuint fragment_shader = CompileShader(GL_FRAGMENT_SHADER, glsl_version, fragment_source);
+
+		if (vertex_shader == 0 || fragment_shader == 0)
+		{
+			return false;
+		}
+
+		program = gl.glCreateProgram();
+		gl.glAttachShader(program, vertex_shader);
+		gl.glAttachShader(program, fragment_shader);
+		gl.glBindAttribLocation(program, 0, "a_position");
+		gl.glBindAttribLocation(program, 1, "a_color");
+		gl.glBindAttribLocation(program, 2, "a_size");
+		gl.glBindAttribLocation(program, 3, "a_corner");
+		gl.glLinkProgram(program);
+
+		gl.glDeleteShader(vertex_shader);
+		gl.glDeleteShader(fragment_shader);
+
+		GLint status = 0;
+		gl.glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status == GL_FALSE)
+		{
+			char log[1024];
+			gl.glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+			printf("Map shader failed to link: %s\n", log);
+			return false;
+		}
+
+		uniform_transform = gl.glGetUniformLocation(program, "u_transform");
+		uniform_pixel_size = gl.glGetUniformLocation(program, "u_pixel_size");
+		uniform_round_points = gl.glGetUniformLocation(program, "u_round_points");
+
+		gl.glGenBuffers(1, &line_buffer);
+		gl.glGenBuffers(1, &thing_buffer);
+
+#if !defined(IMGUI_IMPL_OPENGL_ES2)
+		gl.glGenVertexArrays(1, &vertex_array);
+#endif
+
+		valid = true;
+		return true;
+	}
+
+	void Shutdown(void)
+	{
+		if (valid == false)
+		{
+			return;
+		}
+
+		gl.glDeleteBuffers(1, &line_buffer);
+		gl.glDeleteBuffers(1, &thing_buffer);
+		gl.glDeleteProgram(program);
+
+#if !defined(IMGUI_IMPL_OPENGL_ES2)
+		gl.glDeleteVertexArrays(1, &vertex_array);
+#endif
+
+		valid = false;
+	}
+
+	void Upload(const map_c *map)
+	{
+		if (valid == false || map == uploaded_map)
+		{
+			return;
+		}
+
+		std::vector<vertex_s> line_vertices;
+		std::vector<vertex_s> thing_vertices;
+
+		if (map != nullptr)
+		{
+			const map_columns_c &columns = map->columns;
+
+			line_vertices.reserve(columns.LineCount() * 2);
+			for (int i = 0, len = columns.LineCount(); i < len; ++i)
+			{
+				const ImU32 color = ((map->linedefs[i].flags & 1) == 0) ? IM_COL32(200, 200, 200, 100) : IM_COL32(200, 200, 200, 200);
+
+				line_vertices.push_back({ columns.line_x0[i], columns.line_y0[i], color, 0.0f, 0.0f, 0.0f });
+				line_vertices.push_back({ columns.line_x1[i], columns.line_y1[i], color, 0.0f, 0.0f, 0.0f });
+			}
+
+			// Things are squares, two triangles each, rather than points. A point is
+			// dropped whole once its middle leaves the screen, and is capped in size.
+			static const float CORNERS[6][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, -1 }, { 1, 1 }, { -1, 1 } };
+
+			thing_vertices.reserve(columns.ThingCount() * 6);
+			for (int i = 0, len = columns.ThingCount(); i < len; ++i)
+			{
+				const auto &info = thing_types_c::Info(columns.thing_category[i]);
+				for (const auto &corner : CORNERS)
+				{
+					thing_vertices.push_back({ columns.thing_x[i], columns.thing_y[i], info.color, info.radius, corner[0], corner[1] });
+				}
+			}
+		}
+
+		gl.glBindBuffer(GL_ARRAY_BUFFER, line_buffer);
+		gl.glBufferData(GL_ARRAY_BUFFER, line_vertices.size() * sizeof(vertex_s), line_vertices.data(), GL_STATIC_DRAW);
+
+		gl.glBindBuffer(GL_ARRAY_BUFFER, thing_buffer);
+		gl.glBufferData(GL_ARRAY_BUFFER, thing_vertices.size() * sizeof(vertex_s), thing_vertices.data(), GL_STATIC_DRAW);
+
+		gl.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		line_vertex_count = (GLsizei)line_vertices.size();
+		thing_vertex_count = (GLsizei)thing_vertices.size();
+		uploaded_map = map;
+	}
+
+	void BindVertices(GLuint buffer)
+	{
+		gl.glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		gl.glEnableVertexAttribArray(0);
+		gl.glEnableVertexAttribArray(1);
+		gl.glEnableVertexAttribArray(2);
+		gl.glEnableVertexAttribArray(3);
+		gl.glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_s), (void *)offsetof(vertex_s, x));
+		gl.glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vertex_s), (void *)offsetof(vertex_s, color));
+		gl.glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(vertex_s), (void *)offsetof(vertex_s, size));
+		gl.glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_s), (void *)offsetof(vertex_s, corner_x));
+	}
+
+	void Render(void)
+	{
+		gl.glUseProgram(program);
+		gl.glUniform4f(uniform_transform, transform[0], transform[1], transform[2], transform[3]);
+
+#if !defined(IMGUI_IMPL_OPENGL_ES2)
+		gl.glBindVertexArray(vertex_array);
+#endif
+
+		glDisable(GL_SCISSOR_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		gl.glUniform1f(uniform_pixel_size, pixel_size);
+
+		BindVertices(line_buffer);
+		gl.glUniform1f(uniform_round_points, 0.0f);
+		glDrawArrays(GL_LINES, 0, line_vertex_count);
+
+		BindVertices(thing_buffer);
+		gl.glUniform1f(uniform_round_points, 1.0f);
+		glDrawArrays(GL_TRIANGLES, 0, thing_vertex_count);
+	}
+
+	static void DrawCallback(const ImDrawList *, const ImDrawCmd *cmd)
+	{
+		((map_renderer_c *)cmd->UserCallbackData)->Render();
+	}
+
+	// Queues the map to be drawn in the middle of the given draw list,
+	// with ImGui's own render state restored straight after.
+	void Submit(ImDrawList *draw_list)
+	{
+		if (valid == false || line_vertex_count + thing_vertex_count == 0)
+		{
+			return;
+		}
+
+		draw_list->AddCallback(DrawCallback, this);
+		draw_list->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+	}
+};
+
+// A fixed-width set of items, so that requirement checks are a handful of ANDs.
+class item_set_c
+{
+public:
+	static constexpr int WORD_COUNT = 4;
+	static constexpr int MAX_ITEMS = WORD_COUNT * 64;
+
+	// Never held by anyone. Rules whose item couldn't be given an id require it instead,
+	// so their region stays locked rather than silently losing the requirement.
+	static constexpr int UNOBTAINABLE = MAX_ITEMS - 1;
+
+	uint64_t words[WORD_COUNT];
+
+	item_set_c() : words{}
+	{
+	}
+
+	void Set(int item_id)
+	{
+		words[item_id >> 6] |= (1ULL << (item_id & 63));
+	}
+
+	void Reset(int item_id)
+	{
+		words[item_id >> 6] &= ~(1ULL << (item_id & 63));
+	}
+
+	bool Test(int item_id) const
+	{
+		return ((words[item_id >> 6] >> (item_id & 63)) & 1) != 0;
+	}
+
+	// True if every item in other is also in this set.
+	bool Contains(const item_set_c &other) const
+	{
+		uint64_t missing = 0;
+		for (int i = 0; i < WORD_COUNT; ++i)
+		{
+			missing |= (other.words[i] & ~words[i]);
+		}
+
+		return (missing == 0);
+	}
+
+	bool Empty(void) const
+	{
+		uint64_t any = 0;
+		for (int i = 0; i < WORD_COUNT; ++i)
+		{
+			any |= words[i];
+		}
+
+		return (any == 0);
+	}
+
+	item_set_c &operator|=(const item_set_c &other)
+	{
+		for (int i = 0; i < WORD_COUNT; ++i)
+		{
+			words[i] |= other.words[i];
+		}
+
+		return *this;
+	}
+
+	bool operator==(const item_set_c &other) const
+	{
+		return (memcmp(words, other.words, sizeof(words)) == 0);
+	}
+};
+
+// Interns item and ability names into small integer ids shared by every region.
+class item_dictionary_c
+{
+public:
+	std::mutex mutex;
+	std::unordered_map<std::string, int> ids;
+	std::vector<std::string> names;
+
+	static item_dictionary_c &Global(void)
+	{
+		static item_dictionary_c dictionary;
+		return dictionary;
+	}
+
+	// Returns the id for the name, adding it if it's new, or -1 if the dictionary is full.
+	int Intern(const std::string &name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = ids.find(name);
+		if (it != ids.end())
+		{
+			return it->second;
+		}
+
+		if ((int)names.size() >= item_set_c::UNOBTAINABLE)
+		{
+			printf("Too many distinct items, %s can never be obtained\n", name.c_str());
+			return -1;
+		}
+
+		int id = (int)names.size();
+		ids[name] = id;
+		names.push_back(name);
+		return id;
+	}
+
+	int Find(const std::string &name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = ids.find(name);
+		return (it != ids.end()) ? it->second : -1;
+	}
+
+	std::string Name(int id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return (id >= 0 && id < (int)names.size()) ? names[id] : std::string();
+	}
+
+	int Count(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return (int)names.size();
+	}
+};
+
+// Random streams that are never shared between threads, unlike rand()'s.
+class random_c
+{
+public:
+	// Seeded once per thread from the OS, for things that don't need to be reproducible.
+	static std::mt19937 &Thread(void)
+	{
+		thread_local std::mt19937 engine(std::random_device{}());
+		return engine;
+	}
+
+	// Spreads nearby seeds (0, 1, 2...) out into unrelated engine states.
+	static uint64_t Mix(uint64_t seed)
+	{
+		seed += 0x9E3779B97F4A7C15ULL;
+		seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+		return seed ^ (seed >> 31);
+	}
+};
+
+// The outline of a region that isn't just a box: any number of closed loops of
+// edges in map space, from a polygon or from the borders of a group of sectors.
+// A point is inside when it's surrounded by an odd number of loops. Rather than
+// test every edge, the bounds are split into a grid where each cell knows whether
+// its center is inside and which edges pass through it. A query then only counts
+// the edges crossed on the way from its cell's center to the point.
+class region_shape_c
+{
+public:
+	struct edge_s
+	{
+		ImVec2 a, b;
+	};
+
+	// One piece of the inside, for drawing it filled: flat along y0 and y1,
+	// running from left0 to right0 along the bottom and left1 to right1 along the top
+	struct trapezoid_s
+	{
+		float y0, y1;
+		float left0, right0;
+		float left1, right1;
+	};
+
+	static constexpr int MAX_CELLS_PER_SIDE = 32;
+
+	std::vector<edge_s> edges;
+	ImVec2 min, max;
+
+	int cells_per_side;
+	ImVec2 cell_size;
+
+	// Stored CSR style: the edges touching cell N are cell_edges[cell_offsets[N]] .. cell_edges[cell_offsets[N + 1]]
+	std::vector<uint32_t> cell_offsets;
+	std::vector<uint32_t> cell_edges;
+	std::vector<uint8_t> cell_center_inside;
+
+	std::vector<trapezoid_s> fill_trapezoids;
+
+	region_shape_c() : min(0.0f, 0.0f), max(0.0f, 0.0f), cells_per_side(0), cell_size(1.0f, 1.0f)
+	{
+	}
+
+	// The lines with one of the sectors on one side and none of them on the other
+	static std::vector<edge_s> SectorEdges(const map_c &map, const std::vector<int> &sector_ids)
+	{
+		std::vector<uint8_t> in_set(map.sectors.size(), 0);
+		for (int sector_id : sector_ids)
+		{
+			if (sector_id >= 0 && sector_id < (int)in_set.size())
+			{
+				in_set[sector_id] = 1;
+			}
+		}
+
+		std::vector<edge_s> edge_list;
+
+		for (int i = 0, len = (int)map.linedefs.size(); i < len; ++i)
+		{
+			const auto &line = map.linedefs[i];
+			const bool front = (line.side_id_front != map_linedef_s::NO_SIDEDEF && in_set[map.sidedefs[line.side_id_front].sector_id] != 0);
+			const bool back = (line.side_id_back != map_linedef_s::NO_SIDEDEF && in_set[map.sidedefs[line.side_id_back].sector_id] != 0);
+
+			if (front != back)
+			{
+				edge_list.push_back({ map.columns.LineStart(i), map.columns.LineEnd(i) });
+			}
+		}
+
+		return edge_list;
+	}
+
+	static std::vector<edge_s> PolygonEdges(const std::vector<ImVec2> &points)
+	{
+		std::vector<edge_s> edge_list;
+		edge_list.reserve(points.size());
+
+		for (size_t i = 0, len = points.size(); i < len; ++i)
+		{
+			edge_list.push_back({ points[i], points[(i + 1) % len] });
+		}
+
+		return edge_list;
+	}
+
+	// Shoots a ray to the right of the point past every edge. Only used while building.
+	static bool RayInside(std::span<const edge_s> edge_list, float x, float y)
+	{
+		bool inside = false;
+
+		for (const auto &edge : edge_list)
+		{
+			if ((edge.a.y > y) != (edge.b.y > y)
+				&& x < edge.a.x + (y - edge.a.y) * (edge.b.x - edge.a.x) / (edge.b.y - edge.a.y))
+			{
+				inside = !inside;
+			}
+		}
+
+		return inside;
+	}
+
+	static double Orient(const ImVec2 &a, const ImVec2 &b, const ImVec2 &c)
+	{
+		return ((double)b.x - a.x) * ((double)c.y - a.y) - ((double)b.y - a.y) * ((double)c.x - a.x);
+	}
+
+	static bool SegmentsCross(const ImVec2 &p0, const ImVec2 &p1, const edge_s &edge)
+	{
+		return ((Orient(edge.a, edge.b, p0) > 0.0) != (Orient(edge.a, edge.b, p1) > 0.0))
+			&& ((Orient(p0, p1, edge.a) > 0.0) != (Orient(p0, p1, edge.b) > 0.0));
+	}
+
+	void CellRange(float min_value, float max_value, float origin, float size, int &first, int &last) const
+	{
+		first = std::clamp((int)floorf((min_value - origin) / size), 0, cells_per_side - 1);
+		last = std::clamp((int)floorf((max_value - origin) / size), 0, cells_per_side - 1);
+	}
+
+	void Build(std::vector<edge_s> edge_list)
+	{
+		edges = std::move(edge_list);
+		min = ImVec2(FLT_MAX, FLT_MAX);
+		max = ImVec2(-FLT_MAX, -FLT_MAX);
+
+		for (const auto &edge : edges)
+		{
+			min = ImVec2(std::min({ min.x, edge.a.x, edge.b.x }), std::min({ min.y, edge.a.y, edge.b.y }));
+			max = ImVec2(std::max({ max.x, edge.a.x, edge.b.x }), std::max({ max.y, edge.a.y, edge.b.y }));
+		}
+
+		if (edges.size() == 0)
+		{
+			min = max = ImVec2(0.0f, 0.0f);
+		}
+
+		// About one edge per cell on average
+		cells_per_side = std::clamp((int)ceilf(sqrtf((float)edges.size())), 1, MAX_CELLS_PER_SIDE);
+		cell_size = ImVec2(std::max((max.x - min.x) / cells_per_side, 1.0f), std::max((max.y - min.y) / cells_per_side, 1.0f));
+
+		const int cell_count = cells_per_side * cells_per_side;
+		cell_offsets.assign(cell_count + 1, 0);
+
+		auto for_each_cell = [&](const edge_s &edge, auto &&func)
+		{
+			int x0, x1, y0, y1;
+			CellRange(std::min(edge.a.x, edge.b.x), std::max(edge.a.x, edge.b.x), min.x, cell_size.x, x0, x1);
+			CellRange(std::min(edge.a.y, edge.b.y), std::max(edge.a.y, edge.b.y), min.y, cell_size.y, y0, y1);
+
+			for (int cell_y = y0; cell_y <= y1; ++cell_y)
+			{
+				for (int cell_x = x0; cell_x <= x1; ++cell_x)
+				{
+					func(cell_y * cells_per_side + cell_x);
+				}
+			}
+		};
+
+		for (const auto &edge : edges)
+		{
+			for_each_cell(edge, [&](int cell) { cell_offsets[cell + 1]++; });
+		}
+
+		for (int i = 0; i < cell_count; ++i)
+		{
+			cell_offsets[i + 1] += cell_offsets[i];
+		}
+
+		cell_edges.resize(cell_offsets[cell_count]);
+		std::vector<uint32_t> cursor(cell_offsets.begin(), cell_offsets.end() - 1);
+
+		for (uint32_t i = 0, len = (uint32_t)edges.size(); i < len; ++i)
+		{
+			for_each_cell(edges[i], [&](int cell) { cell_edges[cursor[cell]++] = i; });
+		}
+
+		cell_center_inside.resize(cell_count);
+		for (int cell = 0; cell < cell_count; ++cell)
+		{
+			const ImVec2 center = CellCenter(cell % cells_per_side, cell / cells_per_side);
+			cell_center_inside[cell] = RayInside(edges, center.x, center.y) ? 1 : 0;
+		}
+
+		BuildFillTrapezoids();
+	}
+
+	ImVec2 CellCenter(int cell_x, int cell_y) const
+	{
+		return ImVec2(min.x + (cell_x + 0.5f) * cell_size.x, min.y + (cell_y + 0.5f) * cell_size.y);
+	}
+
+	// Where a non-horizontal edge is at height y
+	static float XAt(const edge_s &edge, float y)
+	{
+		return edge.a.x + (y - edge.a.y) * (edge.b.x - edge.a.x) / (edge.b.y - edge.a.y);
+	}
+
+	// Cuts the inside into trapezoids exactly. The bounds are split into bands at the
+	// height of every edge's ends, so no edge starts or stops within a band, and each
+	// pair of crossings in a band is one trapezoid. A pair that carries on along the
+	// same two edges into the next band stretches the trapezoid instead of adding one.
+	void BuildFillTrapezoids(void)
+	{
+		fill_trapezoids.clear();
+
+		std::vector<float> heights;
+		heights.reserve(edges.size() * 2);
+		for (const auto &edge : edges)
+		{
+			heights.push_back(edge.a.y);
+			heights.push_back(edge.b.y);
+		}
+
+		std::sort(heights.begin(), heights.end());
+		heights.erase(std::unique(heights.begin(), heights.end()), heights.end());
+
+		struct crossing_s
+		{
+			float x;
+			uint32_t edge_id;
+		};
+
+		std::vector<crossing_s> crossings;
+
+		// Trapezoids the band below left open, by the pair of edges they run along
+		std::vector<std::pair<uint64_t, size_t>> open, next_open;
+
+		for (size_t band = 0; band + 1 < heights.size(); ++band)
+		{
+			const float y0 = heights[band];
+			const float y1 = heights[band + 1];
+			const float y = (y0 + y1) * 0.5f;
+
+			crossings.clear();
+			for (uint32_t i = 0; i < (uint32_t)edges.size(); ++i)
+			{
+				if ((edges[i].a.y > y) != (edges[i].b.y > y))
+				{
+					crossings.push_back({ XAt(edges[i], y), i });
+				}
+			}
+
+			std::sort(crossings.begin(), crossings.end(), [](const crossing_s &a, const crossing_s &b) { return a.x < b.x; });
+
+			next_open.clear();
+			for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+			{
+				const edge_s &left = edges[crossings[i].edge_id];
+				const edge_s &right = edges[crossings[i + 1].edge_id];
+				const uint64_t key = ((uint64_t)crossings[i].edge_id << 32) | crossings[i + 1].edge_id;
+
+				auto it = std::find_if(open.begin(), open.end(), [&](const auto &entry) { return entry.first == key; });
+				if (it != open.end())
+				{
+					auto &trapezoid = fill_trapezoids[it->second];
+					trapezoid.y1 = y1;
+					trapezoid.left1 = XAt(left, y1);
+					trapezoid.right1 = XAt(right, y1);
+					next_open.push_back(*it);
+				}
+				else
+				{
+					fill_trapezoids.push_back({ y0, y1, XAt(left, y0), XAt(right, y0), XAt(left, y1), XAt(right, y1) });
+					next_open.push_back({ key, fill_trapezoids.size() - 1 });
+				}
+			}
+
+			std::swap(open, next_open);
+		}
+	}
+
+	bool Contains(float x, float y) const
+	{
+		if (cells_per_side == 0 || x < min.x || x > max.x || y < min.y || y > max.y)
+		{
+			return false;
+		}
+
+		int cell_x, cell_y, unused;
+		CellRange(x, x, min.x, cell_size.x, cell_x, unused);
+		CellRange(y, y, min.y, cell_size.y, cell_y, unused);
+
+		const int cell = cell_y * cells_per_side + cell_x;
+		const ImVec2 center = CellCenter(cell_x, cell_y);
+		const ImVec2 point(x, y);
+
+		bool inside = (cell_center_inside[cell] != 0);
+
+		for (uint32_t i = cell_offsets[cell]; i < cell_offsets[cell + 1]; ++i)
+		{
+			if (SegmentsCross(center, point, edges[cell_edges[i]]) == true)
+			{
+				inside = !inside;
+			}
+		}
+
+		return inside;
+	}
+};
+
+class region_c
+{
+public:
+	std::string title;
+	std::map<std::string, bool> rules;
+	ImVec2 rect_vertex_a, rect_vertex_b;
+	double rect_color[3];
+
+	// rules compiled down by CompileRules; every enabled rule is a required item
+	item_set_c requirements;
+
+	// Enabled rules that didn't fit in the item dictionary. Any at all lock the region for good.
+	int unresolved_rules;
+
+	// A region is a box unless it has a polygon (map space, Y up), or is made of a map's sectors.
+	// Either way the rectangle is kept as its bounds.
+	std::vector<ImVec2> polygon;
+	std::vector<int> sector_ids;
+
+	// Built by BuildShape. Never changed in place, so copies can share it.
+	std::shared_ptr<const region_shape_c> shape;
+
+	// Unique stamp for this version of the region's contents. Copies share it,
+	// so anything holding an older copy can tell whether it's still current.
+	uint64_t revision;
+
+	region_c() : unresolved_rules(0)
+	{
+		Touch();
+		title = "Untitled region";
+
+		rect_vertex_a = ImVec2(-64.0f, -64.0f);
+		rect_vertex_b = ImVec2(64.0f, 64.0f);
+
+		std::mt19937 &random = random_c::Thread();
+
+		double hue = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+		rect_color[0] = hue;
+		rect_color[1] = 1.0f;
+		rect_color[2] = 0.0f;
+
+		for (int i = 2; i > 0; i--)
+		{
+			int j = std::uniform_int_distribution<int>(0, i)(random);
+
+			double tmp = rect_color[i];
+			rect_color[i] = rect_color[j];
+			rect_color[j] = tmp;
+		}
+	}
+
+	// Must be called after changing the region, before anything snapshots it again.
+	void Touch(void)
+	{
+		static std::atomic<uint64_t> next_revision = 1;
+		revision = next_revision++;
+	}
+
+	// The rectangle is stored with Y pointing down the screen,
+	// so flip it back when comparing against map coordinates.
+	void MapBounds(ImVec2 &min, ImVec2 &max) const
+	{
+		min = ImVec2(std::min(rect_vertex_a.x, rect_vertex_b.x), std::min(-rect_vertex_a.y, -rect_vertex_b.y));
+		max = ImVec2(std::max(rect_vertex_a.x, rect_vertex_b.x), std::max(-rect_vertex_a.y, -rect_vertex_b.y));
+	}
+
+	bool ContainsMapPoint(float x, float y) const
+	{
+		if (shape != nullptr)
+		{
+			return shape->Contains(x, y);
+		}
+
+		ImVec2 min, max;
+		MapBounds(min, max);
+		return (x >= min.x && x <= max.x && y >= min.y && y <= max.y);
+	}
+
+	bool HasShape(void) const
+	{
+		return (polygon.size() >= 3 || sector_ids.size() > 0);
+	}
+
+	// Must be called after polygon or sector_ids change, before anything asks ContainsMapPoint.
+	// Sector regions need their map; until they get it, they stay a box.
+	void BuildShape(const map_c *map)
+	{
+		std::vector<region_shape_c::edge_s> edges;
+
+		if (polygon.size() >= 3)
+		{
+			edges = region_shape_c::PolygonEdges(polygon);
+		}
+		else if (sector_ids.size() > 0 && map != nullptr)
+		{
+			edges = region_shape_c::SectorEdges(*map, sector_ids);
+		}
+
+		if (edges.size() < 3)
+		{
+			shape = nullptr;
+			return;
+		}
+
+		auto new_shape = std::make_shared<region_shape_c>();
+		new_shape->Build(std::move(edges));
+		shape = new_shape;
+
+		rect_vertex_a = ImVec2(shape->min.x, -shape->max.y);
+		rect_vertex_b = ImVec2(shape->max.x, -shape->min.y);
+	}
+
+	// Stretches the polygon along with the rectangle, after the rectangle moved from old_a, old_b.
+	void FitPolygonToRect(const ImVec2 &old_a, const ImVec2 &old_b)
+	{
+		if (polygon.size() < 3)
+		{
+			return;
+		}
+
+		const ImVec2 old_min(std::min(old_a.x, old_b.x), std::min(-old_a.y, -old_b.y));
+		const ImVec2 old_max(std::max(old_a.x, old_b.x), std::max(-old_a.y, -old_b.y));
+
+		ImVec2 new_min, new_max;
+		MapBounds(new_min, new_max);
+
+		const float scale_x = (old_max.x > old_min.x) ? (new_max.x - new_min.x) / (old_max.x - old_min.x) : 1.0f;
+		const float scale_y = (old_max.y > old_min.y) ? (new_max.y - new_min.y) / (old_max.y - old_min.y) : 1.0f;
+
+		for (auto &point : polygon)
+		{
+			point = ImVec2(new_min.x + (point.x - old_min.x) * scale_x, new_min.y + (point.y - old_min.y) * scale_y);
+		}
+
+		BuildShape(nullptr);
+	}
+
+	nlohmann::json ToJson(void) const
+	{
+		nlohmann::json json = {
+			{ "title", title },
+			{ "rect", { rect_vertex_a.x, rect_vertex_a.y, rect_vertex_b.x, rect_vertex_b.y } },
+			{ "color", { rect_color[0], rect_color[1], rect_color[2] } },
+			{ "rules", rules },
+		};
+
+		if (polygon.size() > 0)
+		{
+			// Flattened to x, y, x, y...
+			nlohmann::json point_list = nlohmann::json::array();
+			for (const auto &point : polygon)
+			{
+				point_list.push_back(point.x);
+				point_list.push_back(point.y);
+			}
+
+			json["polygon"] = point_list;
+		}
+
+		if (sector_ids.size() > 0)
+		{
+			json["sectors"] = sector_ids;
+		}
+
+		return json;
+	}
+
+	// True if json is an array of numbers, of the given size if it isn't 0
+	static bool IsNumberArray(const nlohmann::json &json, size_t size)
+	{
+		if (json.is_array() == false || (size != 0 && json.size() != size))
+		{
+			return false;
+		}
+
+		return std::all_of(json.begin(), json.end(), [](const nlohmann::json &value) { return value.is_number(); });
+	}
+
+	// Reads whatever fields are there. Returns false if any of them has the wrong type,
+	// or the region isn't an object at all, instead of throwing.
+	bool FromJson(const nlohmann::json &json)
+	{
+		if (json.is_object() == false)
+		{
+			return false;
+		}
+
+		bool ok = true;
+
+		auto title_value = json.find("title");
+		if (title_value != json.end())
+		{
+			if (title_value->is_string() == true)
+			{
+				title = title_value->get<std::string>();
+			}
+			else
+			{
+				ok = false;
+			}
+		}
+
+		auto rect = json.find("rect");
+		if (rect != json.end())
+		{
+			if (IsNumberArray(*rect, 4) == true)
+			{
+				rect_vertex_a = ImVec2((*rect)[0].get<float>(), (*rect)[1].get<float>());
+				rect_vertex_b = ImVec2((*rect)[2].get<float>(), (*rect)[3].get<float>());
+			}
+			else
+			{
+				ok = false;
+			}
+		}
+
+		auto color = json.find("color");
+		if (color != json.end())
+		{
+			if (IsNumberArray(*color, 3) == true)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					rect_color[i] = (*color)[i].get<double>();
+				}
+			}
+			else
+			{
+				ok = false;
+			}
+		}
+
+		rules.clear();
+
+		auto rule_list = json.find("rules");
+		if (rule_list != json.end())
+		{
+			if (rule_list->is_object())
+			{
+				for (const auto &[rule_name, rule_value] : rule_list->items())
+				{
+					if (rule_value.is_boolean())
+					{
+						rules[rule_name] = rule_value.get<bool>();
+					}
+					else
+					{
+						ok = false;
+					}
+				}
+			}
+			else
+			{
+				ok = false;
+			}
+		}
+
+		polygon.clear();
+
+		auto point_list = json.find("polygon");
+		if (point_list != json.end())
+		{
+			if (IsNumberArray(*point_list, 0) == true && (point_list->size() % 2) == 0)
+			{
+				for (size_t i = 0; i + 1 < point_list->size(); i += 2)
+				{
+					polygon.emplace_back((*point_list)[i].get<float>(), (*point_list)[i + 1].get<float>());
+				}
+			}
+			else
+			{
+				ok = false;
+			}
+		}
+
+		sector_ids.clear();
+
+		auto sector_list = json.find("sectors");
+		if (sector_list != json.end())
+		{
+			if (sector_list->is_array() == true
+				&& std::all_of(sector_list->begin(), sector_list->end(), [](const nlohmann::json &value) { return value.is_number_integer(); }))
+			{
+				for (const auto &sector_id : *sector_list)
+				{
+					sector_ids.push_back(sector_id.get<int>());
+				}
+			}
+			else
+			{
+				ok = false;
+			}
+		}
+
+		CompileRules();
+		BuildShape(nullptr);
+		Touch();
+		return ok;
+	}
+
+	// Must be called after rules changes, before anything asks CanEnter.
+	// Returns false if some rule's item couldn't be interned, which makes the region unenterable.
+	bool CompileRules(void)
+	{
+		requirements = item_set_c();
+		unresolved_rules = 0;
+
+		for (const auto &[rule_name, enabled] : rules)
+		{
+			if (enabled == false)
+			{
+				continue;
+			}
+
+			int item_id = item_dictionary_c::Global().Intern(rule_name);
+			if (item_id < 0)
+			{
+				item_id = item_set_c::UNOBTAINABLE;
+				unresolved_rules++;
+			}
+
+			requirements.Set(item_id);
+		}
+
+		return (unresolved_rules == 0);
+	}
+
+	bool CanEnter(const item_set_c &inventory) const
+	{
+		return inventory.Contains(requirements);
+	}
+};
+
+// Tracks which region titles are taken, so making one unique doesn't rescan every region.
+// Each base title remembers the next " (n)" suffix to try, so a run of duplicates
+// carries on counting from where the last one left off.
+class region_title_index_c
+{
+public:
+	std::unordered_map<std::string, int> counts;
+	std::unordered_map<std::string, int> next_suffix;
+
+	void Clear(void)
+	{
+		counts.clear();
+		next_suffix.clear();
+	}
+
+	bool Taken(const std::string &title) const
+	{
+		auto it = counts.find(title);
+		return (it != counts.end() && it->second > 0);
+	}
+
+	// Returns the title, or the first free "title (n)", and marks it as taken.
+	std::string Claim(const std::string &title)
+	{
+		std::string unique = title;
+
+		if (Taken(title) == true)
+		{
+			int &suffix = next_suffix.try_emplace(title, 2).first->second;
+
+			do
+			{
+				unique = title + " (" + std::to_string(suffix++) + ")";
+			}
+			while (Taken(unique) == true);
+		}
+
+		counts[unique]++;
+		return unique;
+	}
+
+	void Release(const std::string &title)
+	{
+		auto it = counts.find(title);
+		if (it != counts.end() && --it->second <= 0)
+		{
+			counts.erase(it);
+		}
+	}
+
+	// Starts over from a whole list of regions, renaming any duplicates in it.
+	void Build(std::vector<region_c> &regions)
+	{
+		Clear();
+		counts.reserve(regions.size());
+
+		for (auto &region : regions)
+		{
+			std::string unique = Claim(region.title);
+			if (unique != region.title)
+			{
+				region.title = std::move(unique);
+				region.Touch();
+			}
+		}
+	}
+};
+
+// The regions drawn over one map, as saved to and loaded from a JSON file.
+class region_file_c
+{
+public:
+	std::string wad_path;
+	std::string map_name;
+	std::vector<region_c> regions;
+
+	bool Load(const char *path)
+	{
+		file_mapping_c file;
+		if (file.Open(path, true) == false)
+		{
+			printf("Cannot open region file: %s\n", path);
+			return false;
+		}
+
+		nlohmann::json json = nlohmann::json::parse(file.data, file.data + file.size, nullptr, false);
+		if (json.is_discarded() == true || json.is_object() == false)
+		{
+			printf("Region file is not valid JSON: %s\n", path);
+			return false;
+		}
+
+		auto wad = json.find("wad");
+		auto map = json.find("map");
+		if ((wad != json.end() && wad->is_string() == false) || (map != json.end() && map->is_string() == false))
+		{
+			printf("Region file has a malformed wad or map name: %s\n", path);
+			return false;
+		}
+
+		if (wad != json.end())
+		{
+			wad_path = wad->get<std::string>();
+		}
+
+		if (map != json.end())
+		{
+			map_name = map->get<std::string>();
+		}
+
+		regions.clear();
+
+		auto region_list = json.find("regions");
+		if (region_list != json.end() && region_list->is_array())
+		{
+			for (const auto &region_json : *region_list)
+			{
+				if (regions.emplace_back().FromJson(region_json) == false)
+				{
+					printf("Region %d in %s is malformed\n", (int)regions.size() - 1, path);
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool Save(const char *path) const
+	{
+		return Save(path, wad_path, map_name, (int)regions.size(), [&](int i) -> const region_c & { return regions[i]; });
+	}
+
+	// region_at(i) returns the i-th region, so callers can hand over whatever they keep them in.
+	template<typename F>
+	static bool Save(const char *path, const std::string &wad_path, const std::string &map_name, int region_count, F &&region_at)
+	{
+		nlohmann::json region_list = nlohmann::json::array();
+		for (int i = 0; i < region_count; ++i)
+		{
+			region_list.push_back(region_at(i).ToJson());
+		}
+
+		nlohmann::json json = {
+			{ "wad", wad_path },
+			{ "map", map_name },
+			{ "regions", region_list },
+		};
+
+		FILE *file_ptr = fopen(path, "wb");
+		if (file_ptr == nullptr)
+		{
+			printf("Cannot write region file: %s\n", path);
+			return false;
+		}
+
+		std::string output = json.dump(1, '\t');
+		fwrite(output.data(), 1, output.size(), file_ptr);
+		fclose(file_ptr);
+		return true;
+	}
+};
+
+// Buckets regions into a coarse grid covering all of map space, so asking
+// which regions hold a point only tests the few that share its cell.
+// Cell lists stay sorted by region id, making the first hit the top-most region,
+// and moving one region only touches the cells it left and entered.
+class region_index_c
+{
+public:
+	static constexpr int CELL_SHIFT = 9;
+	static constexpr int WORLD_MIN = -32768;
+	static constexpr int CELLS_PER_SIDE = 65536 >> CELL_SHIFT;
+
+	struct entry_s
+	{
+		ImVec2 min, max;
+		int cell_x0, cell_y0, cell_x1, cell_y1;
+
+		// Regions that aren't boxes still go in by their bounds, but are tested against this
+		std::shared_ptr<const region_shape_c> shape;
+	};
+
+	std::vector<std::vector<int>> cells;
+	std::vector<entry_s> entries;
+
+	static int CellCoord(float value)
+	{
+		int cell = ((int)floorf(std::clamp(value, -32768.0f, 32767.0f)) - WORLD_MIN) >> CELL_SHIFT;
+		return std::clamp(cell, 0, CELLS_PER_SIDE - 1);
+	}
+
+	void Build(const std::vector<region_c> &regions)
+	{
+		cells.assign(CELLS_PER_SIDE * CELLS_PER_SIDE, std::vector<int>());
+		entries.resize(regions.size());
+
+		// Ascending ids, so every cell list comes out sorted
+		for (int i = 0, len = (int)regions.size(); i < len; ++i)
+		{
+			SetEntry(i, regions[i]);
+			ForEachCell(entries[i], [&](std::vector<int> &cell) { cell.push_back(i); });
+		}
+	}
+
+	// Moves one region to wherever its bounds are now.
+	void Update(int region_id, const region_c &region)
+	{
+		if (region_id < 0 || region_id >= (int)entries.size())
+		{
+			return;
+		}
+
+		ForEachCell(entries[region_id], [&](std::vector<int> &cell)
+		{
+			cell.erase(std::lower_bound(cell.begin(), cell.end(), region_id));
+		});
+
+		SetEntry(region_id, region);
+
+		ForEachCell(entries[region_id], [&](std::vector<int> &cell)
+		{
+			cell.insert(std::lower_bound(cell.begin(), cell.end(), region_id), region_id);
+		});
+	}
+
+	bool Contains(int region_id, float x, float y) const
+	{
+		const auto &entry = entries[region_id];
+		return (x >= entry.min.x && x <= entry.max.x && y >= entry.min.y && y <= entry.max.y)
+			&& (entry.shape == nullptr || entry.shape->Contains(x, y));
+	}
+
+	bool HasShape(int region_id) const
+	{
+		return (entries[region_id].shape != nullptr);
+	}
+
+	// Calls func(region_id) for every region containing the point, top-most first.
+	template<typename F>
+	void ForEachAt(float x, float y, F &&func) const
+	{
+		if (cells.size() == 0)
+		{
+			return;
+		}
+
+		for (int region_id : cells[CellCoord(y) * CELLS_PER_SIDE + CellCoord(x)])
+		{
+			if (Contains(region_id, x, y) == true)
+			{
+				func(region_id);
+			}
+		}
+	}
+
+	// Top-most region containing the point, or -1.
+	int FirstAt(float x, float y) const
+	{
+		if (cells.size() == 0)
+		{
+			return -1;
+		}
+
+		for (int region_id : cells[CellCoord(y) * CELLS_PER_SIDE + CellCoord(x)])
+		{
+			if (Contains(region_id, x, y) == true)
+			{
+				return region_id;
+			}
+		}
+
+		return -1;
+	}
+
+	// Calls func(region_id) once for every region overlapping the rectangle, in no particular order.
+	template<typename F>
+	void ForEachInRect(float min_x, float min_y, float max_x, float max_y, F &&func) const
+	{
+		if (cells.size() == 0)
+		{
+			return;
+		}
+
+		const int query_x0 = CellCoord(min_x), query_y0 = CellCoord(min_y);
+		const int query_x1 = CellCoord(max_x), query_y1 = CellCoord(max_y);
+
+		for (int cell_y = query_y0; cell_y <= query_y1; ++cell_y)
+		{
+			for (int cell_x = query_x0; cell_x <= query_x1; ++cell_x)
+			{
+				for (int region_id : cells[cell_y * CELLS_PER_SIDE + cell_x])
+				{
+					const auto &entry = entries[region_id];
+
+					// Only report from the first cell the region and the query share
+					if (cell_x != std::max(query_x0, entry.cell_x0) || cell_y != std::max(query_y0, entry.cell_y0))
+					{
+						continue;
+					}
+
+					if (entry.min.x <= max_x && entry.max.x >= min_x && entry.min.y <= max_y && entry.max.y >= min_y)
+					{
+						func(region_id);
+					}
+				}
+			}
+		}
+	}
+
+	// Finds the regions holding each of a batch of points in one pass, written CSR style:
+	// point i's regions are ids[offsets[i]] .. ids[offsets[i + 1]], top-most first.
+	template<typename F>
+	void Classify(int point_count, F &&get_point, std::vector<uint32_t> &offsets, std::vector<int> &ids) const
+	{
+		offsets.assign(point_count + 1, 0);
+		ids.clear();
+
+		for (int i = 0; i < point_count; ++i)
+		{
+			const ImVec2 point = get_point(i);
+			ForEachAt(point.x, point.y, [&](int region_id) { ids.push_back(region_id); });
+			offsets[i + 1] = (uint32_t)ids.size();
+		}
+	}
+
+	void ClassifyThings(const map_columns_c &columns, std::vector<uint32_t> &offsets, std::vector<int> &ids) const
+	{
+		Classify(columns.ThingCount(), [&](int i) { return columns.Thing(i); }, offsets, ids);
+	}
+
+	void SetEntry(int region_id, const region_c &region)
+	{
+		auto &entry = entries[region_id];
+		region.MapBounds(entry.min, entry.max);
+		entry.shape = region.shape;
+
+		entry.cell_x0 = CellCoord(entry.min.x);
+		entry.cell_y0 = CellCoord(entry.min.y);
+		entry.cell_x1 = CellCoord(entry.max.x);
+		entry.cell_y1 = CellCoord(entry.max.y);
+	}
+
+	template<typename F>
+	void ForEachCell(const entry_s &entry, F &&func)
+	{
+		for (int cell_y = entry.cell_y0; cell_y <= entry.cell_y1; ++cell_y)
+		{
+			for (int cell_x = entry.cell_x0; cell_x <= entry.cell_x1; ++cell_x)
+			{
+				func(cells[cell_y * CELLS_PER_SIDE + cell_x]);
+			}
+		}
+	}
+};
+
+// Connects regions whose bounds overlap or touch, stored CSR style.
+// Each region only looks for neighbours among the ones the index puts near it.
+class region_graph_c
+{
+public:
+	std::vector<uint32_t> offsets;
+	std::vector<int> neighbours;
+
+	// index must be built from the same regions
+	void Build(const std::vector<region_c> &regions, const region_index_c &index)
+	{
+		const int region_count = (int)regions.size();
+
+		offsets.assign(region_count + 1, 0);
+		neighbours.clear();
+
+		for (int i = 0; i < region_count; ++i)
+		{
+			ImVec2 min, max;
+			regions[i].MapBounds(min, max);
+
+			const size_t first = neighbours.size();
+			index.ForEachInRect(min.x, min.y, max.x, max.y, [&](int region_id)
+			{
+				if (region_id != i)
+				{
+					neighbours.push_back(region_id);
+				}
+			});
+
+			// Ascending, so reachability walks them in the same order every time
+			std::sort(neighbours.begin() + first, neighbours.end());
+			offsets[i + 1] = (uint32_t)neighbours.size();
+		}
+	}
+
+	std::span<const int> Neighbours(int region_id) const
+	{
+		return std::span<const int>(neighbours.data() + offsets[region_id], neighbours.data() + offsets[region_id + 1]);
+	}
+};
+
+// Sweeps which regions a player can reach from a start region with the items they hold.
+// Adding or removing an item only re-evaluates the regions downstream of the change:
+// every reachable region remembers the neighbour it was first reached from, so removing
+// an item only has to unwind the part of that tree which depended on it.
+class reachability_c
+{
+public:
+	region_graph_c graph;
+	std::vector<item_set_c> requirements;
+
+	// Regions requiring each item, so a change only looks at the regions it affects
+	std::vector<std::vector<int>> item_regions;
+
+	int start_region;
+	item_set_c inventory;
+	std::vector<uint16_t> item_counts;
+
+	std::vector<uint8_t> reachable;
+	std::vector<int> parent;
+	int reachable_count;
+
+	std::vector<int> queue;
+
+	reachability_c() : start_region(-1), reachable_count(0)
+	{
+	}
+
+	// Solves once, with the given items already held. index must be built from the same regions.
+	void Reset(const std::vector<region_c> &regions, const region_index_c &index, int start_region_id, const item_set_c &items = item_set_c())
+	{
+		const int region_count = (int)regions.size();
+
+		graph.Build(regions, index);
+		requirements.resize(region_count);
+		item_regions.assign(item_set_c::MAX_ITEMS, std::vector<int>());
+
+		for (int i = 0; i < region_count; ++i)
+		{
+			requirements[i] = regions[i].requirements;
+
+			for (int item_id = 0; item_id < item_set_c::MAX_ITEMS; ++item_id)
+			{
+				if (requirements[i].Test(item_id) == true)
+				{
+					item_regions[item_id].push_back(i);
+				}
+			}
+		}
+
+		start_region = (start_region_id >= 0 && start_region_id < region_count) ? start_region_id : -1;
+		SetInventory(items);
+	}
+
+	void SetInventory(const item_set_c &items)
+	{
+		inventory = items;
+		item_counts.resize(item_set_c::MAX_ITEMS);
+
+		for (int item_id = 0; item_id < item_set_c::MAX_ITEMS; ++item_id)
+		{
+			item_counts[item_id] = inventory.Test(item_id) ? 1 : 0;
+		}
+
+		Solve();
+	}
+
+	// Full sweep from scratch
+	void Solve(void)
+	{
+		reachable.assign(requirements.size(), 0);
+		parent.assign(requirements.size(), -1);
+		reachable_count = 0;
+		queue.clear();
+
+		if (start_region < 0)
+		{
+			return;
+		}
+
+		// The player spawns in the start region, so it's never locked
+		reachable[start_region] = 1;
+		reachable_count++;
+		queue.push_back(start_region);
+
+		Propagate();
+	}
+
+	// Floods outwards from everything in the queue
+	void Propagate(void)
+	{
+		for (size_t head = 0; head < queue.size(); ++head)
+		{
+			const int region_id = queue[head];
+
+			for (int next : graph.Neighbours(region_id))
+			{
+				if (reachable[next] == 0 && inventory.Contains(requirements[next]) == true)
+				{
+					reachable[next] = 1;
+					parent[next] = region_id;
+					reachable_count++;
+					queue.push_back(next);
+				}
+			}
+		}
+
+		queue.clear();
+	}
+
+	// Reachable neighbour to enter the region from, or -1
+	int ReachableNeighbour(int region_id) const
+	{
+		for (int next : graph.Neighbours(region_id))
+		{
+			if (reachable[next] != 0)
+			{
+				return next;
+			}
+		}
+
+		return -1;
+	}
+
+	void AddItem(int item_id)
+	{
+		if (item_id < 0 || item_counts[item_id]++ > 0)
+		{
+			// Already had one, so nothing new opens up
+			return;
+		}
+
+		inventory.Set(item_id);
+
+		for (int region_id : item_regions[item_id])
+		{
+			if (reachable[region_id] != 0 || inventory.Contains(requirements[region_id]) == false)
+			{
+				continue;
+			}
+
+			int from = ReachableNeighbour(region_id);
+			if (from >= 0)
+			{
+				reachable[region_id] = 1;
+				parent[region_id] = from;
+				reachable_count++;
+				queue.push_back(region_id);
+			}
+		}
+
+		Propagate();
+	}
+
+	void RemoveItem(int item_id)
+	{
+		if (item_id < 0 || item_counts[item_id] == 0 || --item_counts[item_id] > 0)
+		{
+			// Still holding another one
+			return;
+		}
+
+		inventory.Reset(item_id);
+
+		// Unwind every region that needed the item, along with
+		// everything that was reached by passing through them.
+		std::vector<int> dirty;
+
+		for (int region_id : item_regions[item_id])
+		{
+			if (reachable[region_id] != 0 && region_id != start_region)
+			{
+				reachable[region_id] = 0;
+				dirty.push_back(region_id);
+			}
+		}
+
+		for (size_t head = 0; head < dirty.size(); ++head)
+		{
+			const int region_id = dirty[head];
+
+			for (int next : graph.Neighbours(region_id))
+			{
+				if (reachable[next] != 0 && parent[next] == region_id)
+				{
+					reachable[next] = 0;
+					dirty.push_back(next);
+				}
+			}
+		}
+
+		reachable_count -= (int)dirty.size();
+
+		// Some of those may still be reachable another way
+		for (int region_id : dirty)
+		{
+			parent[region_id] = -1;
+		}
+
+		for (int region_id : dirty)
+		{
+			if (reachable[region_id] != 0 || inventory.Contains(requirements[region_id]) == false)
+			{
+				continue;
+			}
+
+			int from = ReachableNeighbour(region_id);
+			if (from >= 0)
+			{
+				reachable[region_id] = 1;
+				parent[region_id] = from;
+				reachable_count++;
+				queue.push_back(region_id);
+			}
+		}
+
+		Propagate();
+	}
+
+	bool IsReachable(int region_id) const
+	{
+		return (region_id >= 0 && region_id < (int)reachable.size() && reachable[region_id] != 0);
+	}
+};
+
+// Binary project file: every region, its rules, and the WAD and map they were drawn over.
+// Strings are stored once in a shared table, and everything else is fixed size
+// records that refer to them by index. That way a mapped file can be read one
+// region at a time, with nothing parsed up front. All values are little-endian,
+// and every section starts 8 byte aligned. Version 2 added region shapes, as
+// fields on the end of the header, so version 1 files read as having none.
+class project_file_c
+{
+public:
+	static constexpr char MAGIC[8] = { 'S', 'R', 'B', '2', 'A', 'P', 'L', 'P' };
+	static constexpr uint32_t VERSION = 2;
+	static constexpr uint32_t NO_STRING = 0xFFFFFFFF;
+
+	// The structs below go to and from disk with plain memcpy, which is only the file's byte order on little-endian hosts
+	static_assert(std::endian::native == std::endian::little, "Project files are read and written as little-endian structs");
+
+	struct header_s
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t header_size;
+
+		uint32_t wad_path;
+		uint32_t map_name;
+
+		uint32_t string_count;
+		uint32_t string_data_size;
+		uint32_t region_count;
+		uint32_t rule_count;
+
+		uint64_t string_offset;
+		uint64_t string_data_offset;
+		uint64_t region_offset;
+		uint64_t rule_offset;
+
+		// Version 2
+		uint32_t shape_count;
+		uint32_t point_count;
+		uint32_t sector_id_count;
+		uint32_t reserved;
+
+		uint64_t shape_offset;
+		uint64_t point_offset;
+		uint64_t sector_id_offset;
+	};
+
+	static constexpr uint32_t HEADER_V1_SIZE = offsetof(header_s, shape_count);
+
+	struct string_s
+	{
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	struct region_s
+	{
+		float rect[4];
+		double color[3];
+		uint32_t title;
+		uint32_t first_rule;
+		uint32_t rule_count;
+		uint32_t reserved;
+	};
+
+	struct rule_s
+	{
+		uint32_t name;
+		uint32_t enabled;
+	};
+
+	// One per region, in the same order
+	struct shape_s
+	{
+		uint32_t first_point;
+		uint32_t point_count;
+		uint32_t first_sector_id;
+		uint32_t sector_id_count;
+	};
+
+	struct point_s
+	{
+		float x, y;
+	};
+
+	file_mapping_c file;
+	bool valid;
+	header_s header;
+
+	std::span<const string_s> strings;
+	std::span<const char> string_data;
+	std::span<const region_s> region_records;
+	std::span<const rule_s> rule_records;
+	std::span<const shape_s> shape_records;
+	std::span<const point_s> point_records;
+	std::span<const int32_t> sector_id_records;
+
+	project_file_c() : valid(false), header{}
+	{
+	}
+
+	template<typename T>
+	std::span<const T> Section(uint64_t offset, uint32_t count)
+	{
+		if (offset > file.size || (file.size - offset) / sizeof(T) < count
+			|| ((uintptr_t)(file.data + offset) % alignof(T)) != 0)
+		{
+			return std::span<const T>();
+		}
+
+		return std::span<const T>((const T *)(file.data + offset), count);
+	}
+
+	// Only checks the header and section bounds; records are decoded as they're asked for.
+	bool Open(const char *path)
+	{
+		valid = false;
+
+		if (file.Open(path, true) == false)
+		{
+			printf("Cannot open project file: %s\n", path);
+			return false;
+		}
+
+		if (file.size < HEADER_V1_SIZE)
+		{
+			printf("Project file is too small: %s\n", path);
+			return false;
+		}
+
+		header = {};
+		memcpy(&header, file.data, HEADER_V1_SIZE);
+
+		if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+		{
+			printf("Not a project file: %s\n", path);
+			return false;
+		}
+
+		if (header.version == 0 || header.version > VERSION)
+		{
+			printf("Project file %s is version %u, but only up to %u is supported\n", path, header.version, VERSION);
+			return false;
+		}
+
+		if (header.header_size < HEADER_V1_SIZE || header.header_size > file.size)
+		{
+			printf("Project file has a bad header: %s\n", path);
+			return false;
+		}
+
+		// Older headers stop short, leaving the newer fields zeroed
+		memcpy(&header, file.data, std::min<size_t>(header.header_size, sizeof(header_s)));
+
+		strings = Section<string_s>(header.string_offset, header.string_count);
+		string_data = Section<char>(header.string_data_offset, header.string_data_size);
+		region_records = Section<region_s>(header.region_offset, header.region_count);
+		rule_records = Section<rule_s>(header.rule_offset, header.rule_count);
+		shape_records = Section<shape_s>(header.shape_offset, header.shape_count);
+		point_records = Section<point_s>(header.point_offset, header.point_count);
+		sector_id_records = Section<int32_t>(header.sector_id_offset, header.sector_id_count);
+
+		if (strings.size() != header.string_count || string_data.size() != header.string_data_size
+			|| region_records.size() != header.region_count || rule_records.size() != header.rule_count
+			|| shape_records.size() != header.shape_count || point_records.size() != header.point_count
+			|| sector_id_records.size() != header.sector_id_count)
+		{
+			printf("Project file is truncated: %s\n", path);
+			return false;
+		}
+
+		valid = true;
+		return true;
+	}
+
+	std::string_view String(uint32_t string_id) const
+	{
+		if (string_id >= strings.size())
+		{
+			return std::string_view();
+		}
+
+		const auto &entry = strings[string_id];
+		if (entry.offset > string_data.size() || string_data.size() - entry.offset < entry.length)
+		{
+			return std::string_view();
+		}
+
+		return std::string_view(string_data.data() + entry.offset, entry.length);
+	}
+
+	int RegionCount(void) const
+	{
+		return (int)region_records.size();
+	}
+
+	void ReadRegion(int region_id, region_c &region) const
+	{
+		const auto &record = region_records[region_id];
+
+		region.title = String(record.title);
+		region.rect_vertex_a = ImVec2(record.rect[0], record.rect[1]);
+		region.rect_vertex_b = ImVec2(record.rect[2], record.rect[3]);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			region.rect_color[i] = record.color[i];
+		}
+
+		region.rules.clear();
+
+		if (record.first_rule <= rule_records.size() && rule_records.size() - record.first_rule >= record.rule_count)
+		{
+			for (const auto &rule : rule_records.subspan(record.first_rule, record.rule_count))
+			{
+				region.rules[std::string(String(rule.name))] = (rule.enabled != 0);
+			}
+		}
+
+		region.polygon.clear();
+		region.sector_ids.clear();
+
+		if (region_id < (int)shape_records.size())
+		{
+			const auto &shape = shape_records[region_id];
+
+			if (shape.first_point <= point_records.size() && point_records.size() - shape.first_point >= shape.point_count)
+			{
+				for (const auto &point : point_records.subspan(shape.first_point, shape.point_count))
+				{
+					region.polygon.emplace_back(point.x, point.y);
+				}
+			}
+
+			if (shape.first_sector_id <= sector_id_records.size() && sector_id_records.size() - shape.first_sector_id >= shape.sector_id_count)
+			{
+				auto sector_ids = sector_id_records.subspan(shape.first_sector_id, shape.sector_id_count);
+				region.sector_ids.assign(sector_ids.begin(), sector_ids.end());
+			}
+		}
+
+		region.CompileRules();
+		region.BuildShape(nullptr);
+		region.Touch();
+	}
+
+	void ReadRegions(std::vector<region_c> &regions) const
+	{
+		regions.resize(region_records.size());
+
+		for (int i = 0, len = RegionCount(); i < len; ++i)
+		{
+			ReadRegion(i, regions[i]);
+		}
+	}
+
+	// Lays out a whole project in memory, ready to be written in one go.
+	// region_at(i) returns the i-th region, so callers can hand over whatever they keep them in.
+	template<typename F>
+	static std::vector<uint8_t> Encode(const std::string &wad_path, const std::string &map_name, int region_count, F &&region_at)
+	{
+		std::vector<string_s> string_list;
+		std::string string_blob;
+		std::unordered_map<std::string_view, uint32_t> string_ids;
+
+		// Views point into the regions, which outlive this function
+		auto intern = [&](const std::string &str) -> uint32_t
+		{
+			auto it = string_ids.find(str);
+			if (it != string_ids.end())
+			{
+				return it->second;
+			}
+
+			uint32_t id = (uint32_t)string_list.size();
+			string_list.push_back({ (uint32_t)string_blob.size(), (uint32_t)str.size() });
+			string_blob += str;
+			string_ids.emplace(str, id);
+			return id;
+		};
+
+		header_s out_header = {};
+		memcpy(out_header.magic, MAGIC, sizeof(MAGIC));
+		out_header.version = VERSION;
+		out_header.header_size = sizeof(header_s);
+		out_header.wad_path = intern(wad_path);
+		out_header.map_name = intern(map_name);
+
+		std::vector<region_s> region_list(region_count);
+		std::vector<rule_s> rule_list;
+		std::vector<shape_s> shape_list(region_count);
+		std::vector<point_s> point_list;
+		std::vector<int32_t> sector_id_list;
+
+		for (int i = 0; i < region_count; ++i)
+		{
+			const region_c &region = region_at(i);
+			auto &record = region_list[i];
+
+			record.rect[0] = region.rect_vertex_a.x;
+			record.rect[1] = region.rect_vertex_a.y;
+			record.rect[2] = region.rect_vertex_b.x;
+			record.rect[3] = region.rect_vertex_b.y;
+
+			for (int j = 0; j < 3; ++j)
+			{
+				record.color[j] = region.rect_color[j];
+			}
+
+			record.title = intern(region.title);
+			record.first_rule = (uint32_t)rule_list.size();
+			record.rule_count = (uint32_t)region.rules.size();
+			record.reserved = 0;
+
+			for (const auto &[rule_name, enabled] : region.rules)
+			{
+				rule_list.push_back({ intern(rule_name), enabled ? 1u : 0u });
+			}
+
+			auto &shape = shape_list[i];
+			shape.first_point = (uint32_t)point_list.size();
+			shape.point_count = (uint32_t)region.polygon.size();
+			shape.first_sector_id = (uint32_t)sector_id_list.size();
+			shape.sector_id_count = (uint32_t)region.sector_ids.size();
+
+			for (const auto &point : region.polygon)
+			{
+				point_list.push_back({ point.x, point.y });
+			}
+
+			sector_id_list.insert(sector_id_list.end(), region.sector_ids.begin(), region.sector_ids.end());
+		}
+
+		std::vector<uint8_t> bytes(sizeof(header_s));
+
+		auto append = [&bytes](const void *data, size_t size) -> uint64_t
+		{
+			bytes.resize((bytes.size() + 7) & ~(size_t)7, 0);
+
+			uint64_t offset = bytes.size();
+			bytes.insert(bytes.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+			return offset;
+		};
+
+		out_header.string_count = (uint32_t)string_list.size();
+		out_header.string_data_size = (uint32_t)string_blob.size();
+		out_header.region_count = (uint32_t)region_list.size();
+		out_header.rule_count = (uint32_t)rule_list.size();
+		out_header.shape_count = (uint32_t)shape_list.size();
+		out_header.point_count = (uint32_t)point_list.size();
+		out_header.sector_id_count = (uint32_t)sector_id_list.size();
+
+		out_header.string_offset = append(string_list.data(), string_list.size() * sizeof(string_s));
+		out_header.string_data_offset = append(string_blob.data(), string_blob.size());
+		out_header.region_offset = append(region_list.data(), region_list.size() * sizeof(region_s));
+		out_header.rule_offset = append(rule_list.data(), rule_list.size() * sizeof(rule_s));
+		out_header.shape_offset = append(shape_list.data(), shape_list.size() * sizeof(shape_s));
+		out_header.point_offset = append(point_list.data(), point_list.size() * sizeof(point_s));
+		out_header.sector_id_offset = append(sector_id_list.data(), sector_id_list.size() * sizeof(int32_t));
+
+		memcpy(bytes.data(), &out_header, sizeof(header_s));
+		return bytes;
+	}
+
+	// Writes to a temporary file, flushes it all the way to disk, then renames it over
+	// the real one, so a crash part way through never leaves a half written project.
+	static bool WriteFile(const char *path, const std::vector<uint8_t> &bytes)
+	{
+		const std::string temp_path = std::string(path) + ".tmp";
+
+		FILE *file_ptr = fopen(temp_path.c_str(), "wb");
+		if (file_ptr == nullptr)
+		{
+			printf("Cannot write project file: %s\n", temp_path.c_str());
+			return false;
+		}
+
+		bool ok = (fwrite(bytes.data(), 1, bytes.size(), file_ptr) == bytes.size());
+		ok = ok && (fflush(file_ptr) == 0);
+#if defined(_WIN32)
+		ok = ok && (_commit(_fileno(file_ptr)) == 0);
+#else
+		ok = ok && (fsync(fileno(file_ptr)) == 0);
+#endif
+		ok = (fclose(file_ptr) == 0) && ok;
+
+		if (ok == false)
+		{
+			printf("Failed writing project file: %s\n", temp_path.c_str());
+			remove(temp_path.c_str());
+			return false;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temp_path, path, error);
+
+		if (error)
+		{
+			printf("Cannot replace project file %s: %s\n", path, error.message().c_str());
+			remove(temp_path.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	static bool Save(const char *path, const std::string &wad_path, const std::string &map_name, const std::vector<region_c> &regions)
+	{
+		auto bytes = Encode(wad_path, map_name, (int)regions.size(), [&](int i) -> const region_c & { return regions[i]; });
+		return WriteFile(path, bytes);
+	}
+};
+
+// An immutable copy of the regions, for handing to other threads.
+// Regions are shared with the previous snapshot for as long as their revision
+// hasn't changed, so taking one after a small edit only copies what was edited.
+class region_snapshot_c
+{
+public:
+	std::vector<std::shared_ptr<const region_c>> regions;
+
+	static std::shared_ptr<const region_snapshot_c> Take(const region_snapshot_c *previous, const std::vector<region_c> &regions)
+	{
+		auto snapshot = std::make_shared<region_snapshot_c>();
+		snapshot->regions.reserve(regions.size());
+
+		// Only needed once regions have been added, removed or reordered
+		std::unordered_map<uint64_t, std::shared_ptr<const region_c>> by_revision;
+		bool by_revision_built = false;
+
+		for (int i = 0, len = (int)regions.size(); i < len; ++i)
+		{
+			const region_c &region = regions[i];
+			std::shared_ptr<const region_c> shared = nullptr;
+
+			if (previous != nullptr)
+			{
+				if (i < (int)previous->regions.size() && previous->regions[i]->revision == region.revision)
+				{
+					shared = previous->regions[i];
+				}
+				else
+				{
+					if (by_revision_built == false)
+					{
+						by_revision.reserve(previous->regions.size());
+						for (const auto &old_region : previous->regions)
+						{
+							by_revision.emplace(old_region->revision, old_region);
+						}
+						by_revision_built = true;
+					}
+
+					auto it = by_revision.find(region.revision);
+					if (it != by_revision.end())
+					{
+						shared = it->second;
+					}
+				}
+			}
+
+			if (shared == nullptr)
+			{
+				shared = std::make_shared<const region_c>(region);
+			}
+
+			snapshot->regions.push_back(std::move(shared));
+		}
+
+		return snapshot;
+	}
+
+	int Count(void) const
+	{
+		return (int)regions.size();
+	}
+
+	const region_c &At(int region_id) const
+	{
+		return *regions[region_id];
+	}
+};
+
+// Writes projects on a worker thread, so saving never holds up a frame.
+// Saves queued while one is being written are merged: only the newest
+// snapshot for each path is kept, since it already includes the older ones.
+class project_saver_c
+{
+public:
+	struct job_s
+	{
+		std::string path;
+		std::string wad_path;
+		std::string map_name;
+		std::shared_ptr<const region_snapshot_c> snapshot;
+
+		// Also write a JSON copy next to the project, for diffing
+		bool write_json;
+	};
+
+	std::atomic_bool busy;
+	std::atomic<int> failures;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<job_s> pending;
+	bool stopping;
+
+	std::thread worker;
+
+	// Called from the worker thread every time a save has finished or failed.
+	std::function<void()> on_finished;
+
+	project_saver_c() : busy(false), failures(0), stopping(false)
+	{
+	}
+
+	~project_saver_c()
+	{
+		Stop();
+	}
+
+	// Writes out anything still queued, then shuts the worker down.
+	void Stop(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		wake.notify_all();
+
+		if (worker.joinable() == true)
+		{
+			worker.join();
+		}
+	}
+
+	void Queue(job_s job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			auto it = std::find_if(pending.begin(), pending.end(),
+				[&job](const job_s &other) { return other.path == job.path; });
+
+			if (it != pending.end())
+			{
+				*it = std::move(job);
+			}
+			else
+			{
+				pending.push_back(std::move(job));
+			}
+
+			busy = true;
+
+			if (worker.joinable() == false)
+			{
+				stopping = false;
+				worker = std::thread([this]() { Work(); });
+			}
+		}
+
+		wake.notify_one();
+	}
+
+	static bool Write(const job_s &job)
+	{
+		const region_snapshot_c &snapshot = *job.snapshot;
+		auto region_at = [&snapshot](int i) -> const region_c & { return snapshot.At(i); };
+
+		auto bytes = project_file_c::Encode(job.wad_path, job.map_name, snapshot.Count(), region_at);
+		if (project_file_c::WriteFile(job.path.c_str(), bytes) == false)
+		{
+			return false;
+		}
+
+		if (job.write_json == true)
+		{
+			std::string json_path = std::filesystem::path(job.path).replace_extension(".json").string();
+			region_file_c::Save(json_path.c_str(), job.wad_path, job.map_name, snapshot.Count(), region_at);
+		}
+
+		printf("Saved %d regions to %s\n", snapshot.Count(), job.path.c_str());
+		return true;
+	}
+
+	void Work(void)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while (true)
+		{
+			wake.wait(lock, [this]() { return stopping == true || pending.empty() == false; });
+
+			if (pending.empty() == true)
+			{
+				// Only get here once stopping, with nothing left to write
+				break;
+			}
+
+			job_s job = std::move(pending.front());
+			pending.erase(pending.begin());
+			lock.unlock();
+
+			if (Write(job) == false)
+			{
+				failures++;
+			}
+
+			lock.lock();
+			busy = (pending.empty() == false);
+
+			if (on_finished)
+			{
+				on_finished();
+			}
+		}
+	}
+};
+
+// Undo and redo for region edits. Each entry only stores what one edit changed,
+// such as the two corners of a rectangle or the one rule that was toggled,
+// never a copy of every region. An entry stays open while an edit is still going,
+// so a whole drag lands as a single step, and the oldest entries are dropped
+// once the history uses more memory than its budget.
+class edit_history_c
+{
+public:
+	enum edit_kind_e
+	{
+		EDIT_RECT,
+		EDIT_TITLE,
+		EDIT_RULE,
+		EDIT_MOVE,
+		EDIT_ADD,
+		EDIT_SHAPE,
+	};
+
+	// A rule can be missing altogether, or there and either enabled or not
+	enum rule_state_e : int8_t
+	{
+		RULE_ABSENT,
+		RULE_OFF,
+		RULE_ON,
+	};
+
+	// Each kind of edit only carries what it needs to be undone and redone.
+	// They're listed in edit_kind_e's order, so an entry's kind is its payload's index.
+	struct rect_edit_s
+	{
+		ImVec2 before_a, before_b;
+		ImVec2 after_a, after_b;
+	};
+
+	struct title_edit_s
+	{
+		std::string before, after;
+	};
+
+	struct rule_edit_s
+	{
+		std::string rule_name;
+		rule_state_e before, after;
+	};
+
+	// Where the region ended up
+	struct move_edit_s
+	{
+		int to_id;
+	};
+
+	// The regions as they were added to the end of the list, for redoing it
+	struct add_edit_s
+	{
+		std::vector<region_c> regions;
+	};
+
+	struct shape_edit_s
+	{
+		rect_edit_s rect;
+		std::vector<ImVec2> before_polygon, after_polygon;
+		std::vector<int> before_sectors, after_sectors;
+	};
+
+	using payload_t = std::variant<rect_edit_s, title_edit_s, rule_edit_s, move_edit_s, add_edit_s, shape_edit_s>;
+
+	struct edit_s
+	{
+		int region_id;
+
+		// Still being added to by the edit that started it
+		bool open;
+
+		payload_t payload;
+
+		edit_kind_e Kind(void) const
+		{
+			return (edit_kind_e)payload.index();
+		}
+
+		size_t Bytes(void) const
+		{
+			size_t bytes = sizeof(edit_s);
+
+			if (const auto *title = std::get_if<title_edit_s>(&payload))
+			{
+				bytes += title->before.capacity() + title->after.capacity();
+			}
+			else if (const auto *rule = std::get_if<rule_edit_s>(&payload))
+			{
+				bytes += rule->rule_name.capacity();
+			}
+			else if (const auto *shape = std::get_if<shape_edit_s>(&payload))
+			{
+				bytes += (shape->before_polygon.capacity() + shape->after_polygon.capacity()) * sizeof(ImVec2)
+					+ (shape->before_sectors.capacity() + shape->after_sectors.capacity()) * sizeof(int);
+			}
+			else if (const auto *add = std::get_if<add_edit_s>(&payload))
+			{
+				for (const auto &region : add->regions)
+				{
+					bytes += RegionBytes(region);
+				}
+			}
+
+			return bytes;
+		}
+	};
+
+	static size_t RegionBytes(const region_c &region)
+	{
+		size_t bytes = sizeof(region_c) + region.title.capacity()
+			+ region.polygon.capacity() * sizeof(ImVec2) + region.sector_ids.capacity() * sizeof(int);
+
+		for (const auto &[rule_name, enabled] : region.rules)
+		{
+			bytes += sizeof(std::pair<const std::string, bool>) + rule_name.capacity();
+		}
+
+		return bytes;
+	}
+
+	std::deque<edit_s> undo_list;
+	std::vector<edit_s> redo_list;
+	size_t used_bytes;
+	size_t budget_bytes;
+
+	edit_history_c() : used_bytes(0), budget_bytes(4 * 1024 * 1024)
+	{
+	}
+
+	void Clear(void)
+	{
+		undo_list.clear();
+		redo_list.clear();
+		used_bytes = 0;
+	}
+
+	bool CanUndo(void) const
+	{
+		return (undo_list.empty() == false);
+	}
+
+	bool CanRedo(void) const
+	{
+		return (redo_list.empty() == false);
+	}
+
+	// The current edit is over; whatever comes next starts a new entry.
+	void Seal(void)
+	{
+		if (undo_list.empty() == false)
+		{
+			undo_list.back().open = false;
+		}
+	}
+
+	void RecordRect(int region_id, const ImVec2 &before_a, const ImVec2 &before_b, const ImVec2 &after_a, const ImVec2 &after_b)
+	{
+		edit_s *top = OpenTop(EDIT_RECT, region_id);
+		if (top != nullptr)
+		{
+			auto &rect = std::get<rect_edit_s>(top->payload);
+			rect.after_a = after_a;
+			rect.after_b = after_b;
+			return;
+		}
+
+		Push(region_id, rect_edit_s{ before_a, before_b, after_a, after_b }, true);
+	}
+
+	// Polygon points being dragged around stay one entry, like a rectangle does
+	void RecordShape(int region_id, const std::vector<ImVec2> &before_polygon, const std::vector<int> &before_sectors,
+		const ImVec2 &before_a, const ImVec2 &before_b, const region_c &after)
+	{
+		edit_s *top = OpenTop(EDIT_SHAPE, region_id);
+		if (top != nullptr)
+		{
+			used_bytes -= top->Bytes();
+			auto &shape = std::get<shape_edit_s>(top->payload);
+			shape.after_polygon = after.polygon;
+			shape.after_sectors = after.sector_ids;
+			shape.rect.after_a = after.rect_vertex_a;
+			shape.rect.after_b = after.rect_vertex_b;
+			used_bytes += top->Bytes();
+			return;
+		}
+
+		Push(region_id, shape_edit_s{
+			{ before_a, before_b, after.rect_vertex_a, after.rect_vertex_b },
+			before_polygon, after.polygon,
+			before_sectors, after.sector_ids,
+		}, true);
+	}
+
+	void RecordTitle(int region_id, const std::string &before, const std::string &after)
+	{
+		Push(region_id, title_edit_s{ before, after }, false);
+	}
+
+	void RecordRule(int region_id, const std::string &rule_name, rule_state_e before, rule_state_e after)
+	{
+		Push(region_id, rule_edit_s{ rule_name, before, after }, false);
+	}
+
+	// Dragging a region through the list swaps it along one step at a time;
+	// those all merge into one move from where it started to where it stopped.
+	void RecordMove(int from_id, int to_id)
+	{
+		if (undo_list.empty() == false && undo_list.back().open == true
+			&& undo_list.back().Kind() == EDIT_MOVE && std::get<move_edit_s>(undo_list.back().payload).to_id == from_id)
+		{
+			std::get<move_edit_s>(undo_list.back().payload).to_id = to_id;
+			redo_list.clear();
+			return;
+		}
+
+		Push(from_id, move_edit_s{ to_id }, true);
+	}
+
+	// Regions added together, like a whole map's worth of seeded ones, are one step
+	void RecordAdd(int first_id, std::span<const region_c> added)
+	{
+		Push(first_id, add_edit_s{ std::vector<region_c>(added.begin(), added.end()) }, false);
+	}
+
+	// Takes the newest entry off the undo list and parks it on the redo list.
+	// The caller applies it backwards.
+	const edit_s *Undo(void)
+	{
+		if (undo_list.empty() == true)
+		{
+			return nullptr;
+		}
+
+		used_bytes -= undo_list.back().Bytes();
+		redo_list.push_back(std::move(undo_list.back()));
+		undo_list.pop_back();
+
+		redo_list.back().open = false;
+		return &redo_list.back();
+	}
+
+	// The opposite of Undo; the caller applies the entry forwards again.
+	const edit_s *Redo(void)
+	{
+		if (redo_list.empty() == true)
+		{
+			return nullptr;
+		}
+
+		used_bytes += redo_list.back().Bytes();
+		undo_list.push_back(std::move(redo_list.back()));
+		redo_list.pop_back();
+
+		Trim();
+		return &undo_list.back();
+	}
+
+	edit_s *OpenTop(edit_kind_e kind, int region_id)
+	{
+		if (undo_list.empty() == true)
+		{
+			return nullptr;
+		}
+
+		edit_s &top = undo_list.back();
+		if (top.open == false || top.Kind() != kind || top.region_id != region_id)
+		{
+			return nullptr;
+		}
+
+		redo_list.clear();
+		return &top;
+	}
+
+	void Push(int region_id, payload_t payload, bool open)
+	{
+		Seal();
+		redo_list.clear();
+
+		undo_list.push_back({ region_id, open, std::move(payload) });
+		used_bytes += undo_list.back().Bytes();
+		Trim();
+	}
+
+	// Always keeps the newest entry, even if it alone is over budget
+	void Trim(void)
+	{
+		while (used_bytes > budget_bytes && undo_list.size() > 1)
+		{
+			used_bytes -= undo_list.front().Bytes();
+			undo_list.pop_front();
+		}
+	}
+};
+
+// Proposes regions for a map by flood filling its sectors, stopping at anything
+// that keeps the player from just walking across: impassable lines, lines with
+// an action, changes in sector special, and steps too high to climb or gaps too
+// low to fit through. Each connected group of sectors becomes one region made of them.
+class region_seeder_c
+{
+public:
+	// Tallest floor step the player walks up without jumping
+	static constexpr int MAX_STEP = 24;
+	// Shortest opening the player fits through
+	static constexpr int PLAYER_HEIGHT = 48;
+	// Groups smaller than this across are left out
+	static constexpr float MIN_SIZE = 16.0f;
+
+	static constexpr int16_t LINE_IMPASSABLE = 1;
+
+	static bool Passable(const map_sector_s &from, const map_sector_s &to, const sector_edge_s &edge)
+	{
+		if ((edge.flags & LINE_IMPASSABLE) != 0 || edge.action != 0 || from.special != to.special)
+		{
+			return false;
+		}
+
+		if (abs(edge.floor_step) > MAX_STEP)
+		{
+			return false;
+		}
+
+		const int gap = std::min(from.ceiling_height, to.ceiling_height) - std::max(from.floor_height, to.floor_height);
+		return (gap >= PLAYER_HEIGHT);
+	}
+
+	static std::vector<region_c> Seed(const map_c &map)
+	{
+		std::vector<region_c> regions;
+
+		const int sector_count = (int)map.sectors.size();
+		if (map.loaded == false || sector_count == 0)
+		{
+			return regions;
+		}
+
+		std::vector<ImVec2> mins, maxs;
+		map.SectorBounds(mins, maxs);
+
+		std::vector<uint8_t> visited(sector_count, 0);
+		std::vector<int> stack;
+		std::vector<int> group;
+
+		for (int seed_id = 0; seed_id < sector_count; ++seed_id)
+		{
+			const auto &seed_sector = map.sectors[seed_id];
+
+			// Closed off sectors, like shut doors, can't be stood in
+			if (visited[seed_id] != 0 || seed_sector.ceiling_height - seed_sector.floor_height < PLAYER_HEIGHT)
+			{
+				continue;
+			}
+
+			ImVec2 min(FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX);
+
+			visited[seed_id] = 1;
+			stack.push_back(seed_id);
+			group.clear();
+
+			while (stack.empty() == false)
+			{
+				const int sector_id = stack.back();
+				stack.pop_back();
+				group.push_back(sector_id);
+
+				min = ImVec2(std::min(min.x, mins[sector_id].x), std::min(min.y, mins[sector_id].y));
+				max = ImVec2(std::max(max.x, maxs[sector_id].x), std::max(max.y, maxs[sector_id].y));
+
+				for (const auto &edge : map.sector_graph.Neighbours(sector_id))
+				{
+					if (visited[edge.sector_id] == 0 && Passable(map.sectors[sector_id], map.sectors[edge.sector_id], edge) == true)
+					{
+						visited[edge.sector_id] = 1;
+						stack.push_back(edge.sector_id);
+					}
+				}
+			}
+
+			if (max.x - min.x < MIN_SIZE || max.y - min.y < MIN_SIZE)
+			{
+				continue;
+			}
+
+			auto &region = regions.emplace_back();
+			region.title = map.name + " area " + std::to_string(regions.size());
+
+			// Regions keep Y pointing down the screen
+			region.rect_vertex_a = ImVec2(min.x, -max.y);
+			region.rect_vertex_b = ImVec2(max.x, -min.y);
+
+			std::sort(group.begin(), group.end());
+			region.sector_ids = group;
+			region.BuildShape(&map);
+			region.Touch();
+		}
+
+		return regions;
+	}
+
+	// Seeds every map at once across the thread pool, one list of regions per map.
+	static std::vector<std::vector<region_c>> SeedAll(std::span<const std::shared_ptr<map_c>> maps, thread_pool_c &pool = thread_pool_c::Shared())
+	{
+		std::vector<std::vector<region_c>> results(maps.size());
+
+		pool.ParallelFor((int)maps.size(), [&](int i)
+		{
+			results[i] = Seed(*maps[i]);
+		});
+
+		return results;
+	}
+};
+
+// Places every item the regions' rules ask for onto things inside the regions,
+// using assumed fill: each item goes somewhere reachable while assuming the
+// player already holds all the items not yet placed. Each seed is then checked
+// from scratch for beatability. Seeds run in parallel, each with its own
+// random stream derived from the seed number, so any seed can be reproduced
+// no matter how many threads generated it.
+class seed_generator_c
+{
+public:
+	// A thing an item can be placed on, and the region it's in.
+	// Only the thing types flagged as locations count, like monitors and emblems.
+	struct location_s
+	{
+		int thing_id;
+		int region_id;
+	};
+
+	struct report_s
+	{
+		int requested;
+		int generated;
+		int filled;
+		int beatable;
+		double seconds;
+
+		// The first few seeds that failed, in run order, to reproduce them
+		std::vector<uint64_t> failed_seeds;
+
+		double SeedsPerSecond(void) const
+		{
+			return (seconds > 0.0) ? (generated / seconds) : 0.0;
+		}
+	};
+
+	static constexpr int SEEDS_PER_TASK = 64;
+	static constexpr int MAX_FAILED_SEEDS = 16;
+
+	std::vector<location_s> locations;
+	std::vector<int> item_pool;
+	reachability_c base_reachability;
+
+	// Everything one seed needs to scribble on, owned by one task at a time
+	class worker_c
+	{
+	public:
+		std::mt19937_64 random;
+		reachability_c reachability;
+		std::vector<int> placement;
+		std::vector<uint8_t> collected;
+		std::vector<int> items;
+		std::vector<int> candidates;
+	};
+
+	bool Prepare(const map_c &map, const std::vector<region_c> &regions, int start_region_id)
+	{
+		locations.clear();
+		item_pool.clear();
+
+		if (start_region_id < 0 || start_region_id >= (int)regions.size())
+		{
+			printf("Seed generation needs a start region\n");
+			return false;
+		}
+
+		region_index_c index;
+		index.Build(regions);
+
+		// Overlapping regions give the thing to the first one in the list
+		for (uint32_t i : map.thing_categories.ThingsWithFlags(thing_types_c::FLAG_LOCATION))
+		{
+			int region_id = index.FirstAt(map.columns.thing_x[i], map.columns.thing_y[i]);
+			if (region_id >= 0)
+			{
+				locations.push_back({ (int)i, region_id });
+			}
+		}
+
+		item_set_c required;
+		for (const auto &region : regions)
+		{
+			required |= region.requirements;
+		}
+
+		// Nothing can be placed to open up a region that needs the unobtainable item
+		for (int item_id = 0; item_id < item_set_c::UNOBTAINABLE; ++item_id)
+		{
+			if (required.Test(item_id) == true)
+			{
+				item_pool.push_back(item_id);
+			}
+		}
+
+		if (item_pool.size() > locations.size())
+		{
+			printf("Seed generation needs %d locations, but the regions only cover %d location things\n",
+				(int)item_pool.size(), (int)locations.size());
+			return false;
+		}
+
+		base_reachability.Reset(regions, index, start_region_id);
+		return true;
+	}
+
+	// Collects every placed item the player can get to, until nothing new opens up.
+	void Sweep(worker_c &worker, const item_set_c &inventory) const
+	{
+		worker.reachability.SetInventory(inventory);
+		worker.collected.assign(locations.size(), 0);
+
+		bool changed = true;
+		while (changed == true)
+		{
+			changed = false;
+
+			for (int i = 0, len = (int)locations.size(); i < len; ++i)
+			{
+				if (worker.collected[i] == 0 && worker.placement[i] >= 0
+					&& worker.reachability.IsReachable(locations[i].region_id) == true)
+				{
+					worker.collected[i] = 1;
+					worker.reachability.AddItem(worker.placement[i]);
+					changed = true;
+				}
+			}
+		}
+	}
+
+	bool Fill(worker_c &worker) const
+	{
+		worker.placement.assign(locations.size(), -1);
+		worker.items = item_pool;
+		std::shuffle(worker.items.begin(), worker.items.end(), worker.random);
+
+		while (worker.items.size() > 0)
+		{
+			const int item_id = worker.items.back();
+			worker.items.pop_back();
+
+			item_set_c assumed;
+			for (int remaining : worker.items)
+			{
+				assumed.Set(remaining);
+			}
+
+			Sweep(worker, assumed);
+
+			worker.candidates.clear();
+			for (int i = 0, len = (int)locations.size(); i < len; ++i)
+			{
+				if (worker.placement[i] < 0 && worker.reachability.IsReachable(locations[i].region_id) == true)
+				{
+					worker.candidates.push_back(i);
+				}
+			}
+
+			if (worker.candidates.size() == 0)
+			{
+				return false;
+			}
+
+			int pick = std::uniform_int_distribution<int>(0, (int)worker.candidates.size() - 1)(worker.random);
+			worker.placement[worker.candidates[pick]] = item_id;
+		}
+
+		return true;
+	}
+
+	// Beatable when, starting empty handed, every item can be collected.
+	bool Validate(worker_c &worker) const
+	{
+		Sweep(worker, item_set_c());
+
+		for (int item_id : item_pool)
+		{
+			if (worker.reachability.inventory.Test(item_id) == false)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	report_s Run(int count, uint64_t base_seed, std::stop_token stop = std::stop_token(),
+		std::atomic<int> *progress = nullptr, thread_pool_c &pool = thread_pool_c::Shared()) const
+	{
+		report_s report = {};
+		report.requested = count;
+
+		std::atomic<int> generated = 0, filled = 0, beatable = 0;
+		std::mutex failed_mutex;
+
+		const auto start = std::chrono::steady_clock::now();
+		const int task_count = (count + SEEDS_PER_TASK - 1) / SEEDS_PER_TASK;
+
+		pool.ParallelFor(task_count, [&](int task)
+		{
+			worker_c worker;
+			worker.reachability = base_reachability;
+
+			const int first = task * SEEDS_PER_TASK;
+			const int last = std::min(count, first + SEEDS_PER_TASK);
+
+			for (int i = first; i < last && stop.stop_requested() == false; ++i)
+			{
+				const uint64_t seed = base_seed + (uint64_t)i;
+				worker.random.seed(random_c::Mix(seed));
+
+				bool seed_filled = Fill(worker);
+				bool seed_beatable = seed_filled && Validate(worker);
+
+				generated++;
+				filled += seed_filled ? 1 : 0;
+				beatable += seed_beatable ? 1 : 0;
+
+				if (seed_beatable == false)
+				{
+					// Keep the earliest failures in run order, whichever thread gets here first,
+					// so the same base seed and count always report the same seeds
+					std::lock_guard<std::mutex> lock(failed_mutex);
+					auto &failed = report.failed_seeds;
+					failed.insert(std::upper_bound(failed.begin(), failed.end(), seed,
+						[&](uint64_t a, uint64_t b) { return (a - base_seed) < (b - base_seed); }), seed);
+
+					if ((int)failed.size() > MAX_FAILED_SEEDS)
+					{
+						failed.pop_back();
+					}
+				}
+
+				if (progress != nullptr)
+				{
+					(*progress)++;
+				}
+			}
+		});
+
+		report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		report.generated = generated;
+		report.filled = filled;
+		report.beatable = beatable;
+		return report;
+	}
+
+	static void PrintReport(const report_s &report)
+	{
+		printf("Generated %d / %d seeds in %.3f s (%.1f seeds/sec): %d filled, %d beatable\n",
+			report.generated, report.requested, report.seconds, report.SeedsPerSecond(),
+			report.filled, report.beatable);
+
+		for (uint64_t seed : report.failed_seeds)
+		{
+			printf("  failed seed %llu\n", (unsigned long long)seed);
+		}
+	}
+};
+
+// Runs the seed generator off the UI thread against a snapshot of the regions.
+class seed_runner_c
+{
+public:
+	std::atomic_bool busy;
+	std::atomic<int> progress;
+	int requested;
+
+	std::mutex report_mutex;
+	seed_generator_c::report_s report;
+	bool has_report;
+
+	std::stop_source stop_source;
+	std::thread worker;
+
+	// Called from the worker thread once a run has finished.
+	std::function<void()> on_finished;
+
+	seed_runner_c() : busy(false), progress(0), requested(0), report{}, has_report(false)
+	{
+	}
+
+	~seed_runner_c()
+	{
+		Cancel();
+	}
+
+	void Cancel(void)
+	{
+		stop_source.request_stop();
+
+		if (worker.joinable() == true)
+		{
+			worker.join();
+		}
+
+		busy = false;
+	}
+
+	void Start(std::shared_ptr<map_c> map, std::vector<region_c> regions, int start_region_id, int count, uint64_t base_seed)
+	{
+		Cancel();
+
+		requested = count;
+		progress = 0;
+		busy = true;
+		stop_source = std::stop_source();
+
+		worker = std::thread([this, map, regions = std::move(regions), start_region_id, count, base_seed, stop = stop_source.get_token()]()
+		{
+			seed_generator_c generator;
+			seed_generator_c::report_s result = {};
+
+			if (generator.Prepare(*map, regions, start_region_id) == true)
+			{
+				result = generator.Run(count, base_seed, stop, &progress);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(report_mutex);
+				report = result;
+				has_report = true;
+			}
+
+			busy = false;
+
+			if (on_finished)
+			{
+				on_finished();
+			}
+		});
+	}
+};
+
+// Generates logic without a window, for build servers and scripts.
+// Never touches SDL video or OpenGL.
+class batch_c
+{
+public:
+	struct job_s
+	{
+		std::string region_path;
+		region_file_c region_file;
+		std::shared_ptr<map_c> map;
+		bool ok;
+
+		// What <name>.logic.json gets called; unique across the whole run
+		std::string out_name;
+	};
+
+	std::string default_wad_path;
+	std::string out_dir;
+	std::string seed_regions_wad_path;
+	std::vector<job_s> jobs;
+
+	int seed_count;
+	uint64_t base_seed;
+
+	static void PrintUsage(void)
+	{
+		printf("Usage: srb2aplogic --batch [--wad <file.wad>] [--out <dir>] [--seeds <count> [--seed <first>]] <regions.json>...\n");
+		printf("       srb2aplogic --batch --seed-regions <file.wad> [--out <dir>]\n");
+		printf("  --wad   WAD to use for region files that don't name one\n");
+		printf("  --out   Directory to write <regions>.logic.json files to (default: current directory)\n");
+		printf("  --seeds Also generate and validate this many seeds per region file, starting in its first region\n");
+		printf("  --seed  First seed number to generate (default: 0)\n");
+		printf("  --seed-regions Propose regions for every map in the WAD, writing <map>.regions.json files\n");
+	}
+
+	static nlohmann::json GenerateLogic(const map_c &map, const std::vector<region_c> &regions)
+	{
+		region_index_c index;
+		index.Build(regions);
+
+		// Sort every thing and sector into its regions in one pass each
+		std::vector<uint32_t> thing_offsets, sector_offsets;
+		std::vector<int> thing_regions, sector_regions;
+		index.ClassifyThings(map.columns, thing_offsets, thing_regions);
+
+		const std::vector<ImVec2> sector_centers = map.SectorCenters();
+		index.Classify((int)sector_centers.size(), [&](int i) { return sector_centers[i]; }, sector_offsets, sector_regions);
+
+		std::vector<nlohmann::json> thing_lists(regions.size(), nlohmann::json::array());
+		std::vector<nlohmann::json> location_lists(regions.size(), nlohmann::json::array());
+		std::vector<nlohmann::json> sector_lists(regions.size(), nlohmann::json::array());
+
+		for (int i = 0, len = (int)map.things.size(); i < len; ++i)
+		{
+			const auto &thing = map.things[i];
+			const auto &info = thing_types_c::Info(map.columns.thing_category[i]);
+
+			for (uint32_t j = thing_offsets[i]; j < thing_offsets[i + 1]; ++j)
+			{
+				thing_lists[thing_regions[j]].push_back({
+					{ "id", i },
+					{ "type", thing.doomednum },
+					{ "category", info.name },
+					{ "x", thing.x },
+					{ "y", thing.y },
+				});
+			}
+		}
+
+		for (uint32_t i : map.thing_categories.ThingsWithFlags(thing_types_c::FLAG_LOCATION))
+		{
+			for (uint32_t j = thing_offsets[i]; j < thing_offsets[i + 1]; ++j)
+			{
+				location_lists[thing_regions[j]].push_back(i);
+			}
+		}
+
+		for (int i = 0, len = (int)sector_centers.size(); i < len; ++i)
+		{
+			for (uint32_t j = sector_offsets[i]; j < sector_offsets[i + 1]; ++j)
+			{
+				sector_lists[sector_regions[j]].push_back(i);
+			}
+		}
+
+		nlohmann::json region_list = nlohmann::json::array();
+
+		for (int i = 0, len = (int)regions.size(); i < len; ++i)
+		{
+			const auto &region = regions[i];
+
+			ImVec2 min, max;
+			region.MapBounds(min, max);
+
+			region_list.push_back({
+				{ "title", region.title },
+				{ "bounds", { min.x, min.y, max.x, max.y } },
+				{ "rules", region.rules },
+				{ "things", std::move(thing_lists[i]) },
+				{ "locations", std::move(location_lists[i]) },
+				{ "sectors", std::move(sector_lists[i]) },
+			});
+		}
+
+		return {
+			{ "map", map.name },
+			{ "wad", map.wad->path },
+			{ "regions", region_list },
+		};
+	}
+
+	bool ParseArgs(int argc, char **argv)
+	{
+		out_dir = ".";
+		seed_count = 0;
+		base_seed = 0;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			if (strcmp(argv[i], "--batch") == 0)
+			{
+				continue;
+			}
+			else if (strcmp(argv[i], "--wad") == 0 && i + 1 < argc)
+			{
+				default_wad_path = argv[++i];
+			}
+			else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			{
+				out_dir = argv[++i];
+			}
+			else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc)
+			{
+				seed_count = std::max(0, atoi(argv[++i]));
+			}
+			else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			{
+				base_seed = strtoull(argv[++i], nullptr, 10);
+			}
+			else if (strcmp(argv[i], "--seed-regions") == 0 && i + 1 < argc)
+			{
+				seed_regions_wad_path = argv[++i];
+			}
+			else if (argv[i][0] == '-')
+			{
+				printf("Unknown option: %s\n", argv[i]);
+				return false;
+			}
+			else
+			{
+				jobs.emplace_back().region_path = argv[i];
+			}
+		}
+
+		return (jobs.size() > 0 || seed_regions_wad_path.size() > 0);
+	}
+
+	// Region files from different directories can share a name, so later ones
+	// get a -2, -3 and so on rather than overwriting the first one's output.
+	void AssignOutputNames(void)
+	{
+		std::unordered_map<std::string, int> taken;
+
+		for (auto &job : jobs)
+		{
+			const std::string stem = std::filesystem::path(job.region_path).stem().string();
+			job.out_name = stem;
+
+			for (int suffix = 2; taken.count(job.out_name) > 0; ++suffix)
+			{
+				job.out_name = stem + "-" + std::to_string(suffix);
+			}
+
+			if (job.out_name != stem)
+			{
+				printf("%s: writing %s.logic.json, since %s is already taken\n",
+					job.region_path.c_str(), job.out_name.c_str(), stem.c_str());
+			}
+
+			taken[job.out_name] = 1;
+		}
+	}
+
+	// Writes a starting set of regions for every map in a WAD, ready to be touched up by hand
+	bool SeedRegions(thread_pool_c &pool)
+	{
+		auto wad = std::make_shared<wad_c>(seed_regions_wad_path.c_str());
+		if (wad->valid == false)
+		{
+			printf("Cannot open WAD: %s\n", seed_regions_wad_path.c_str());
+			return false;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::shared_ptr<map_c>> maps = map_c::LoadAll(wad, pool);
+		std::vector<std::vector<region_c>> seeded = region_seeder_c::SeedAll(maps, pool);
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("Seeded %d maps in %.3f s\n", (int)maps.size(), seconds);
+
+		std::error_code error;
+		std::filesystem::create_directories(out_dir, error);
+
+		bool ok = true;
+
+		for (size_t i = 0; i < maps.size(); ++i)
+		{
+			region_file_c region_file;
+			region_file.wad_path = seed_regions_wad_path;
+			region_file.map_name = maps[i]->name;
+			region_file.regions = std::move(seeded[i]);
+
+			std::filesystem::path out_path = std::filesystem::path(out_dir) / (maps[i]->name + ".regions.json");
+			if (region_file.Save(out_path.string().c_str()) == false)
+			{
+				ok = false;
+				continue;
+			}
+
+			printf("Wrote %d regions to %s\n", (int)region_file.regions.size(), out_path.string().c_str());
+		}
+
+		return ok;
+	}
+
+	int Run(int argc, char **argv)
+	{
+		if (ParseArgs(argc, argv) == false)
+		{
+			PrintUsage();
+			return EXIT_FAILURE;
+		}
+
+		thread_pool_c &pool = thread_pool_c::Shared();
+
+		if (seed_regions_wad_path.size() > 0)
+		{
+			if (SeedRegions(pool) == false)
+			{
+				return EXIT_FAILURE;
+			}
+
+			if (jobs.empty() == true)
+			{
+				return EXIT_SUCCESS;
+			}
+		}
+
+		AssignOutputNames();
+
+		// Read every region file at once
+		pool.ParallelFor((int)jobs.size(), [&](int i)
+		{
+			auto &job = jobs[i];
+			job.region_file.wad_path = default_wad_path;
+			job.ok = job.region_file.Load(job.region_path.c_str());
+
+			for (const auto &region : job.region_file.regions)
+			{
+				if (job.ok == true && region.unresolved_rules > 0)
+				{
+					printf("%s: region \"%s\" has rules past the %d distinct item limit\n",
+						job.region_path.c_str(), region.title.c_str(), item_set_c::UNOBTAINABLE);
+					job.ok = false;
+				}
+			}
+		});
+
+		// Then decode each distinct map once, sharing WADs between them
+		typedef std::pair<std::string, std::string> map_key_t;
+		std::map<std::string, std::shared_ptr<wad_c>> wads;
+		std::map<map_key_t, std::shared_ptr<map_c>> maps;
+
+		for (auto &job : jobs)
+		{
+			if (job.ok == true && wads.count(job.region_file.wad_path) == 0)
+			{
+				wads[job.region_file.wad_path] = std::make_shared<wad_c>(job.region_file.wad_path.c_str());
+			}
+
+			if (job.ok == true)
+			{
+				maps[{ job.region_file.wad_path, job.region_file.map_name }] = nullptr;
+			}
+		}
+
+		std::vector<decltype(maps)::value_type *> map_list;
+		for (auto &entry : maps)
+		{
+			map_list.push_back(&entry);
+		}
+
+		pool.ParallelFor((int)map_list.size(), [&](int i)
+		{
+			const auto &[wad_path, map_name] = map_list[i]->first;
+			map_list[i]->second = std::make_shared<map_c>(wads.at(wad_path), map_name.c_str());
+		});
+
+		// Finally generate and write the logic for every region file
+		std::error_code error;
+		std::filesystem::create_directories(out_dir, error);
+
+		pool.ParallelFor((int)jobs.size(), [&](int i)
+		{
+			auto &job = jobs[i];
+			if (job.ok == false)
+			{
+				return;
+			}
+
+			job.map = maps.at({ job.region_file.wad_path, job.region_file.map_name });
+			if (job.map == nullptr || job.map->loaded == false)
+			{
+				printf("%s: could not load map %s from %s\n", job.region_path.c_str(),
+					job.region_file.map_name.c_str(), job.region_file.wad_path.c_str());
+				job.ok = false;
+				return;
+			}
+
+			// Regions made of sectors couldn't be shaped until their map was loaded
+			for (auto &region : job.region_file.regions)
+			{
+				region.BuildShape(job.map.get());
+			}
+
+			std::filesystem::path out_path = std::filesystem::path(out_dir)
+				/ (job.out_name + ".logic.json");
+
+			std::string output = GenerateLogic(*job.map, job.region_file.regions).dump(1, '\t');
+
+			FILE *file_ptr = fopen(out_path.string().c_str(), "wb");
+			if (file_ptr == nullptr)
+			{
+				printf("Cannot write logic file: %s\n", out_path.string().c_str());
+				job.ok = false;
+				return;
+			}
+
+			fwrite(output.data(), 1, output.size(), file_ptr);
+			fclose(file_ptr);
+			printf("Wrote %s\n", out_path.string().c_str());
+		});
+
+		// Seeds already spread across the pool, so run one region file at a time
+		if (seed_count > 0)
+		{
+			for (auto &job : jobs)
+			{
+				if (job.ok == false)
+				{
+					continue;
+				}
+
+				printf("%s:\n", job.region_path.c_str());
+
+				seed_generator_c generator;
+				if (generator.Prepare(*job.map, job.region_file.regions, 0) == false)
+				{
+					job.ok = false;
+					continue;
+				}
+
+				seed_generator_c::report_s report = generator.Run(seed_count, base_seed);
+				seed_generator_c::PrintReport(report);
+
+				if (report.beatable < report.requested)
+				{
+					job.ok = false;
+				}
+			}
+		}
+
+		int failed = (int)std::count_if(jobs.begin(), jobs.end(), [](const job_s &job) { return job.ok == false; });
+		printf("Processed %d region files, %d failed\n", (int)jobs.size(), failed);
+
+		return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+};
+
+// Scratch arrays for one batch of geometry to project, kept around between frames.
+// Each entry is a segment from (x0, y0) to (x1, y1); points only use the first end.
+class projection_batch_c
+{
+public:
+	std::vector<uint32_t> ids;
+	std::vector<float> x0, y0;
+	std::vector<float> x1, y1;
+	std::vector<uint8_t> visible;
+
+	void Clear(void)
+	{
+		ids.clear();
+		x0.clear();
+		y0.clear();
+		x1.clear();
+		y1.clear();
+		visible.clear();
+	}
+
+	void AddSegment(uint32_t id, const ImVec2 &a, const ImVec2 &b)
+	{
+		ids.push_back(id);
+		x0.push_back(a.x);
+		y0.push_back(a.y);
+		x1.push_back(b.x);
+		y1.push_back(b.y);
+	}
+
+	void AddPoint(uint32_t id, const ImVec2 &point)
+	{
+		ids.push_back(id);
+		x0.push_back(point.x);
+		y0.push_back(point.y);
+	}
+
+	int Count(void) const
+	{
+		return (int)ids.size();
+	}
+
+	ImVec2 Start(int i) const
+	{
+		return ImVec2(x0[i], y0[i]);
+	}
+
+	ImVec2 End(int i) const
+	{
+		return ImVec2(x1[i], y1[i]);
+	}
+};
+
+// The map to screen transform, with the scale and offset worked out once per view
+// instead of once per point. Batches are projected in place and culled against the
+// clip rectangle in the same pass; the SSE2 or AVX2 kernel is picked at startup.
+class screen_projection_c
+{
+public:
+	// screen.x = offset_x + (map.x * scale), screen.y = offset_y - (map.y * scale)
+	float scale;
+	float offset_x, offset_y;
+
+	// Anything outside of this, in screen space, isn't visible
+	float clip_min_x, clip_min_y;
+	float clip_max_x, clip_max_y;
+
+	typedef void (*segments_f)(const screen_projection_c &view, int start, int count, float margin,
+		float *x0, float *y0, float *x1, float *y1, uint8_t *visible);
+	typedef void (*points_f)(const screen_projection_c &view, int start, int count, float margin,
+		float *x, float *y, uint8_t *visible);
+
+	struct kernel_s
+	{
+		const char *name;
+		segments_f segments;
+		points_f points;
+	};
+
+	screen_projection_c() : scale(1.0f), offset_x(0.0f), offset_y(0.0f),
+		clip_min_x(0.0f), clip_min_y(0.0f), clip_max_x(0.0f), clip_max_y(0.0f)
+	{
+	}
+
+	void Set(const ImVec2 &origin, float new_scale, const ImVec2 &clip_min, const ImVec2 &clip_max)
+	{
+		scale = new_scale;
+		offset_x = origin.x;
+		offset_y = origin.y;
+		clip_min_x = clip_min.x;
+		clip_min_y = clip_min.y;
+		clip_max_x = clip_max.x;
+		clip_max_y = clip_max.y;
+	}
+
+	// The same transform, clipped to a box around a screen point instead,
+	// so the visibility mask says what's under it.
+	screen_projection_c Around(const ImVec2 &point, float half_size) const
+	{
+		screen_projection_c around = *this;
+		around.clip_min_x = point.x - half_size;
+		around.clip_min_y = point.y - half_size;
+		around.clip_max_x = point.x + half_size;
+		around.clip_max_y = point.y + half_size;
+		return around;
+	}
+
+	ImVec2 Project(const ImVec2 &point) const
+	{
+		return ImVec2(offset_x + (point.x * scale), offset_y - (point.y * scale));
+	}
+
+	ImVec2 Unproject(const ImVec2 &point) const
+	{
+		return ImVec2((point.x - offset_x) / scale, (offset_y - point.y) / scale);
+	}
+
+	// Segments are visible if their bounding box, grown by margin, touches the clip rectangle
+	void ProjectSegments(projection_batch_c &batch, float margin) const
+	{
+		batch.visible.resize(batch.ids.size());
+		Kernel().segments(*this, 0, batch.Count(), margin,
+			batch.x0.data(), batch.y0.data(), batch.x1.data(), batch.y1.data(), batch.visible.data());
+	}
+
+	void ProjectPoints(projection_batch_c &batch, float margin) const
+	{
+		batch.visible.resize(batch.ids.size());
+		Kernel().points(*this, 0, batch.Count(), margin,
+			batch.x0.data(), batch.y0.data(), batch.visible.data());
+	}
+
+	static const kernel_s &Kernel(void)
+	{
+		static const kernel_s kernel = PickKernel();
+		return kernel;
+	}
+
+	static kernel_s PickKernel(void)
+	{
+#if defined(SCREEN_PROJECTION_X86)
+		if (CpuHasAVX2() == true)
+		{
+			return { "AVX2", SegmentsAVX2, PointsAVX2 };
+		}
+
+		return { "SSE2", SegmentsSSE2, PointsSSE2 };
+#else
+		return { "Scalar", SegmentsScalar, PointsScalar };
+#endif
+	}
+
+	// Also takes care of the tail the vector kernels leave over
+	static void SegmentsScalar(const screen_projection_c &view, int start, int count, float margin,
+		float *x0, float *y0, float *x1, float *y1, uint8_t *visible)
+	{
+		const float min_x = view.clip_min_x - margin;
+		const float min_y = view.clip_min_y - margin;
+		const float max_x = view.clip_max_x + margin;
+		const float max_y = view.clip_max_y + margin;
+
+		for (int i = start; i < count; ++i)
+		{
+			x0[i] = view.offset_x + (x0[i] * view.scale);
+			y0[i] = view.offset_y - (y0[i] * view.scale);
+			x1[i] = view.offset_x + (x1[i] * view.scale);
+			y1[i] = view.offset_y - (y1[i] * view.scale);
+
+			visible[i] = (std::max(x0[i], x1[i]) >= min_x && std::min(x0[i], x1[i]) <= max_x
+				&& std::max(y0[i], y1[i]) >= min_y && std::min(y0[i], y1[i]) <= max_y) ? 1 : 0;
+		}
+	}
+
+	static void PointsScalar(const screen_projection_c &view, int start, int count, float margin,
+		float *x, float *y, uint8_t *visible)
+	{
+		const float min_x = view.clip_min_x - margin;
+		const float min_y = view.clip_min_y - margin;
+		const float max_x = view.clip_max_x + margin;
+		const float max_y = view.clip_max_y + margin;
+
+		for (int i = start; i < count; ++i)
+		{
+			x[i] = view.offset_x + (x[i] * view.scale);
+			y[i] = view.offset_y - (y[i] * view.scale);
+
+			visible[i] = (x[i] >= min_x && x[i] <= max_x && y[i] >= min_y && y[i] <= max_y) ? 1 : 0;
+		}
+	}
+
+#if defined(SCREEN_PROJECTION_X86)
+	static bool CpuHasAVX2(void)
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+
+		// The OS has to save the YMM registers too, not just the CPU support them
+		const bool has_avx = (info[2] & (1 << 28)) != 0;
+		const bool has_xsave = (info[2] & (1 << 27)) != 0;
+		if (has_avx == false || has_xsave == false || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+
+	static void StoreMask(int mask, int lanes, uint8_t *visible)
+	{
+		for (int lane = 0; lane < lanes; ++lane)
+		{
+			visible[lane] = (mask >> lane) & 1;
+		}
+	}
+
+	static void SegmentsSSE2(const screen_projection_c &view, int start, int count, float margin,
+		float *x0, float *y0, float *x1, float *y1, uint8_t *visible)
+	{
+		const __m128 scale = _mm_set1_ps(view.scale);
+		const __m128 offset_x = _mm_set1_ps(view.offset_x);
+		const __m128 offset_y = _mm_set1_ps(view.offset_y);
+		const __m128 min_x = _mm_set1_ps(view.clip_min_x - margin);
+		const __m128 min_y = _mm_set1_ps(view.clip_min_y - margin);
+		const __m128 max_x = _mm_set1_ps(view.clip_max_x + margin);
+		const __m128 max_y = _mm_set1_ps(view.clip_max_y + margin);
+
+		int i = start;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 ax = _mm_add_ps(offset_x, _mm_mul_ps(_mm_loadu_ps(x0 + i), scale));
+			const __m128 ay = _mm_sub_ps(offset_y, _mm_mul_ps(_mm_loadu_ps(y0 + i), scale));
+			const __m128 bx = _mm_add_ps(offset_x, _mm_mul_ps(_mm_loadu_ps(x1 + i), scale));
+			const __m128 by = _mm_sub_ps(offset_y, _mm_mul_ps(_mm_loadu_ps(y1 + i), scale));
+
+			_mm_storeu_ps(x0 + i, ax);
+			_mm_storeu_ps(y0 + i, ay);
+			_mm_storeu_ps(x1 + i, bx);
+			_mm_storeu_ps(y1 + i, by);
+
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_max_ps(ax, bx), min_x), _mm_cmple_ps(_mm_min_ps(ax, bx), max_x));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_max_ps(ay, by), min_y));
+			inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_min_ps(ay, by), max_y));
+
+			StoreMask(_mm_movemask_ps(inside), 4, visible + i);
+		}
+
+		SegmentsScalar(view, i, count, margin, x0, y0, x1, y1, visible);
+	}
+
+	static void PointsSSE2(const screen_projection_c &view, int start, int count, float margin,
+		float *x, float *y, uint8_t *visible)
+	{
+		const __m128 scale = _mm_set1_ps(view.scale);
+		const __m128 offset_x = _mm_set1_ps(view.offset_x);
+		const __m128 offset_y = _mm_set1_ps(view.offset_y);
+		const __m128 min_x = _mm_set1_ps(view.clip_min_x - margin);
+		const __m128 min_y = _mm_set1_ps(view.clip_min_y - margin);
+		const __m128 max_x = _mm_set1_ps(view.clip_max_x + margin);
+		const __m128 max_y = _mm_set1_ps(view.clip_max_y + margin);
+
+		int i = start;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 px = _mm_add_ps(offset_x, _mm_mul_ps(_mm_loadu_ps(x + i), scale));
+			const __m128 py = _mm_sub_ps(offset_y, _mm_mul_ps(_mm_loadu_ps(y + i), scale));
+
+			_mm_storeu_ps(x + i, px);
+			_mm_storeu_ps(y + i, py);
+
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(px, min_x), _mm_cmple_ps(px, max_x));
+			inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(py, min_y), _mm_cmple_ps(py, max_y)));
+
+			StoreMask(_mm_movemask_ps(inside), 4, visible + i);
+		}
+
+		PointsScalar(view, i, count, margin, x, y, visible);
+	}
+
+	TARGET_AVX2 static void SegmentsAVX2(const screen_projection_c &view, int start, int count, float margin,
+		float *x0, float *y0, float *x1, float *y1, uint8_t *visible)
+	{
+		const __m256 scale = _mm256_set1_ps(view.scale);
+		const __m256 offset_x = _mm256_set1_ps(view.offset_x);
+		const __m256 offset_y = _mm256_set1_ps(view.offset_y);
+		const __m256 min_x = _mm256_set1_ps(view.clip_min_x - margin);
+		const __m256 min_y = _mm256_set1_ps(view.clip_min_y - margin);
+		const __m256 max_x = _mm256_set1_ps(view.clip_max_x + margin);
+		const __m256 max_y = _mm256_set1_ps(view.clip_max_y + margin);
+
+		int i = start;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 ax = _mm256_add_ps(offset_x, _mm256_mul_ps(_mm256_loadu_ps(x0 + i), scale));
+			const __m256 ay = _mm256_sub_ps(offset_y, _mm256_mul_ps(_mm256_loadu_ps(y0 + i), scale));
+			const __m256 bx = _mm256_add_ps(offset_x, _mm256_mul_ps(_mm256_loadu_ps(x1 + i), scale));
+			const __m256 by = _mm256_sub_ps(offset_y, _mm256_mul_ps(_mm256_loadu_ps(y1 + i), scale));
+
+			_mm256_storeu_ps(x0 + i, ax);
+			_mm256_storeu_ps(y0 + i, ay);
+			_mm256_storeu_ps(x1 + i, bx);
+			_mm256_storeu_ps(y1 + i, by);
+
+			__m256 inside = _mm256_and_ps(
+				_mm256_cmp_ps(_mm256_max_ps(ax, bx), min_x, _CMP_GE_OQ),
+				_mm256_cmp_ps(_mm256_min_ps(ax, bx), max_x, _CMP_LE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_max_ps(ay, by), min_y, _CMP_GE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_min_ps(ay, by), max_y, _CMP_LE_OQ));
+
+			StoreMask(_mm256_movemask_ps(inside), 8, visible + i);
+		}
+
+		SegmentsSSE2(view, i, count, margin, x0, y0, x1, y1, visible);
+	}
+
+	TARGET_AVX2 static void PointsAVX2(const screen_projection_c &view, int start, int count, float margin,
+		float *x, float *y, uint8_t *visible)
+	{
+		const __m256 scale = _mm256_set1_ps(view.scale);
+		const __m256 offset_x = _mm256_set1_ps(view.offset_x);
+		const __m256 offset_y = _mm256_set1_ps(view.offset_y);
+		const __m256 min_x = _mm256_set1_ps(view.clip_min_x - margin);
+		const __m256 min_y = _mm256_set1_ps(view.clip_min_y - margin);
+		const __m256 max_x = _mm256_set1_ps(view.clip_max_x + margin);
+		const __m256 max_y = _mm256_set1_ps(view.clip_max_y + margin);
+
+		int i = start;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 px = _mm256_add_ps(offset_x, _mm256_mul_ps(_mm256_loadu_ps(x + i), scale));
+			const __m256 py = _mm256_sub_ps(offset_y, _mm256_mul_ps(_mm256_loadu_ps(y + i), scale));
+
+			_mm256_storeu_ps(x + i, px);
+			_mm256_storeu_ps(y + i, py);
+
+			__m256 inside = _mm256_and_ps(_mm256_cmp_ps(px, min_x, _CMP_GE_OQ), _mm256_cmp_ps(px, max_x, _CMP_LE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(py, min_y, _CMP_GE_OQ), _mm256_cmp_ps(py, max_y, _CMP_LE_OQ)));
+
+			StoreMask(_mm256_movemask_ps(inside), 8, visible + i);
+		}
+
+		PointsSSE2(view, i, count, margin, x, y, visible);
+	}
+#endif
+};
+
+// Accumulates sub-pixel sized geometry into screen space cells,
+// so that a dense cluster of it costs one rectangle instead of hundreds.
+class screen_density_c
+{
+public:
+	static constexpr int CELL_PIXELS = 2;
+
+	ImVec2 origin;
+	int columns, rows;
+	std::vector<uint16_t> counts;
+	std::vector<int> occupied;
+
+	screen_density_c() : columns(0), rows(0)
+	{
+	}
+
+	void Reset(const ImVec2 &pos, const ImVec2 &size)
+	{
+		origin = pos;
+		columns = std::max(1, (int)ceilf(size.x / CELL_PIXELS));
+		rows = std::max(1, (int)ceilf(size.y / CELL_PIXELS));
+		counts.assign(columns * rows, 0);
+		occupied.clear();
+	}
+
+	void Add(const ImVec2 &point)
+	{
+		int cell_x = (int)((point.x - origin.x) / CELL_PIXELS);
+		int cell_y = (int)((point.y - origin.y) / CELL_PIXELS);
+
+		if (cell_x < 0 || cell_x >= columns || cell_y < 0 || cell_y >= rows)
+		{
+			return;
+		}
+
+		uint16_t &count = counts[(cell_y * columns) + cell_x];
+		if (count == 0)
+		{
+			occupied.push_back((cell_y * columns) + cell_x);
+		}
+
+		if (count < UINT16_MAX)
+		{
+			count++;
+		}
+	}
+
+	// Emits one rectangle per occupied cell, more opaque the more it holds.
+	void Flush(ImDrawList *draw_list, int r, int g, int b, int min_alpha, int max_alpha)
+	{
+		for (int cell : occupied)
+		{
+			const float x = origin.x + (float)((cell % columns) * CELL_PIXELS);
+			const float y = origin.y + (float)((cell / columns) * CELL_PIXELS);
+			const int alpha = std::min(max_alpha, min_alpha + (counts[cell] * 16));
+
+			draw_list->AddRectFilled(
+				ImVec2(x, y),
+				ImVec2(x + CELL_PIXELS, y + CELL_PIXELS),
+				IM_COL32(r, g, b, alpha)
+			);
+		}
+	}
+};
+
+class main_c
+{
+public:
+	class sdl_c sdl;
+	class imgui_c imgui;
+
+	std::shared_ptr<map_c> cur_map;
+	map_loader_c map_loader;
+	map_renderer_c map_renderer;
+	bool use_gpu_map;
+	screen_density_c line_density;
+	screen_density_c thing_density;
+
+	// The current map to screen transform, and scratch space for projecting with it
+	screen_projection_c view;
+	projection_batch_c line_batch;
+	projection_batch_c thing_batch;
+	projection_batch_c region_batch;
+	projection_batch_c shape_batch;
+	projection_batch_c polygon_batch;
+
+	// Only redraw when something could have changed, instead of every vsync
+	bool event_driven;
+	int frame_rate_cap;
+	int redraw_frames;
+	bool show_demo_window;
+	Uint32 wake_event;
+
+	profiler_c profiler;
+	bool show_profiler;
+
+	// ImGui needs a couple of frames after input for hover states and such to settle
+	const int REDRAW_SETTLE_FRAMES = 3;
+	const int IDLE_WAIT_MS = 1000;
+	std::string wad_path;
+	std::string map_name;
+	std::string project_path;
+	std::vector<region_c> regions;
+	int selected_region_id;
+
+	// The map the regions were drawn over, which their sector ids refer to
+	std::string regions_wad_path;
+	std::string regions_map_name;
+
+	// Bumped on every edit to regions, so derived data knows when to rebuild
+	int regions_revision;
+
+	region_index_c region_index;
+	int region_index_revision;
+	region_title_index_c region_titles;
+	std::vector<int> visible_regions;
+	edit_history_c history;
+
+	// How many of cur_map's things sit in each region. Counted over again when the map
+	// or the whole set changes; a single region that changes is only recounted itself.
+	std::vector<int> region_thing_counts;
+	int thing_counts_revision;
+	const map_c *thing_counts_map;
+
+	reachability_c reachability;
+	int reachability_revision;
+	int start_region_id;
+	bool show_reachability;
+
+	// What was last handed to project_saver, shared with the next snapshot
+	project_saver_c project_saver;
+	std::shared_ptr<const region_snapshot_c> regions_snapshot;
+	int regions_snapshot_revision;
+
+	bool autosave;
+	int autosave_revision;
+	std::chrono::steady_clock::time_point last_autosave;
+	const std::chrono::seconds AUTOSAVE_INTERVAL = std::chrono::seconds(30);
+
+	seed_runner_c seed_runner;
+	int seed_count;
+	int base_seed;
+	bool show_seed_generator;
+
+	const float GRID_STEP = 64.0f;
+	const float GRID_MIN_PIXELS = 8.0f;
+	const float GRID_MIN = -32768.0f;
+	const float GRID_MAX = 32767.0f;
+
+	const float ZOOM_MIN = 0.01f;
+	const float ZOOM_MAX = 1.0f;
+	const float ZOOM_BASE = 2.0f;
+
+	enum grab_handle_e
+	{
+		GRAB_NULL = 0,
+		GRAB_TOP = 1 << 0,
+		GRAB_LEFT = 1 << 1,
+		GRAB_BOTTOM = 1 << 2,
+		GRAB_RIGHT = 1 << 3,
+		GRAB_ALL = GRAB_TOP|GRAB_LEFT|GRAB_BOTTOM|GRAB_RIGHT,
+	};
+
+	ImVec2 scroll;
+	float zoom;
+	ImVec2 work_pos, work_size;
+
+	main_c() : cur_map(nullptr), use_gpu_map(true),
+		event_driven(true), frame_rate_cap(60), redraw_frames(0), show_demo_window(false), wake_event(0),
+		show_profiler(false),
+		wad_path("MAP01.wad"), map_name("MAP01"), project_path("regions.srb2ap"), selected_region_id(-1),
+		regions_revision(0), region_index_revision(-1), thing_counts_revision(-1), thing_counts_map(nullptr), reachability_revision(-1), start_region_id(0), show_reachability(false),
+		regions_snapshot(nullptr), regions_snapshot_revision(-1), autosave(true), autosave_revision(0), last_autosave(std::chrono::steady_clock::now()),
+		seed_count(1000), base_seed(0), show_seed_generator(false), scroll(ImVec2(0.0f, 0.0f)), zoom(0.5f)
+	{
+		printf("main_c constructor\n");
+
+		if (sdl.window == nullptr)
+		{
+			return;
+		}
+
+		// Setup Platform/Renderer backends
+		ImGui_ImplSDL3_InitForOpenGL(sdl.window, sdl.gl_context);
+		ImGui_ImplOpenGL3_Init(sdl.glsl_version);
+
+		if (map_renderer.Init(sdl.glsl_version) == false)
+		{
+			printf("Falling back to drawing map geometry through ImGui\n");
+		}
+
+		wake_event = SDL_RegisterEvents(1);
+		if (wake_event == (Uint32)-1)
+		{
+			wake_event = SDL_EVENT_USER;
+		}
+
+		map_loader.on_finished = [this]() { Wake(); };
+		seed_runner.on_finished = [this]() { Wake(); };
+
+		imgui.context_valid = true;
+	}
+
+	~main_c()
+	{
+		printf("main_c destructor\n");
+		project_saver.Stop();
+		map_loader.Cancel();
+		seed_runner.Cancel();
+		map_renderer.Shutdown();
+		imgui.~imgui_c();
+		sdl.~sdl_c();
+	}
+
+	bool Frame_Poll(void)
+	{
+		SDL_Event event;
+		bool done = false;
+
+		while (SDL_PollEvent(&event))
+		{
+			ImGui_ImplSDL3_ProcessEvent(&event);
+			redraw_frames = REDRAW_SETTLE_FRAMES;
+
+			if (event.type == SDL_EVENT_QUIT)
+			{
+				done = true;
+			}
+
+			if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED && event.window.windowID == SDL_GetWindowID(sdl.window))
+			{
+				done = true;
+			}
+		}
+
+		return done;
+	}
+
+	void Frame_Init(void)
+	{
+		// Start the Dear ImGui frame
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplSDL3_NewFrame();
 		ImGui::NewFrame();
 
-		const ImGuiViewport *viewport = ImGui::GetMainViewport();
-		work_pos = viewport->WorkPos;
-		work_size = viewport->WorkSize;
+		const ImGuiViewport *viewport = ImGui::GetMainViewport();
+		work_pos = viewport->WorkPos;
+		work_size = viewport->WorkSize;
+		UpdateView();
+	}
+
+	void Frame_Process(void)
+	{
+		// Rendering
+		ImGui::Render();
+
+		glViewport(0, 0, (int)imgui.io.DisplaySize.x, (int)imgui.io.DisplaySize.y);
+		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		profiler.RecordDrawData(ImGui::GetDrawData(), ImGui::GetBackgroundDrawList());
+
+		SDL_GL_SwapWindow(sdl.window);
+	}
+
+	// Call whenever the window, scroll or zoom changes
+	void UpdateView(void)
+	{
+		const ImVec2 origin = ImVec2(
+			work_pos.x + (work_size.x * 0.5f) + (scroll.x * zoom),
+			work_pos.y + (work_size.y * 0.5f) + (scroll.y * zoom)
+		);
+
+		view.Set(origin, zoom * ZOOM_BASE, work_pos, ImVec2(work_pos.x + work_size.x, work_pos.y + work_size.y));
+	}
+
+	ImVec2 MapSpaceToScreenSpace(const ImVec2 &input)
+	{
+		return view.Project(input);
+	}
+
+	ImVec2 ScreenSpaceToMapSpace(const ImVec2 &input)
+	{
+		return view.Unproject(input);
+	}
+
+	void DrawMap(void)
+	{
+		if (imgui.io.WantCaptureMouse == false)
+		{
+			if (imgui.io.MouseWheel != 0.0f)
+			{
+				static const float zoomScrollFactor = (1.0f / 8.0f);
+				zoom = std::clamp(
+					zoom + (imgui.io.MouseWheel * zoomScrollFactor * zoom),
+					ZOOM_MIN,
+					ZOOM_MAX
+				);
+				imgui.io.WantCaptureMouse = true;
+			}
+
+			if (ImGui::IsMouseDragging(ImGuiMouseButton_Right))
+			{
+				scroll.x += imgui.io.MouseDelta.x / zoom;
+				scroll.y += imgui.io.MouseDelta.y / zoom;
+				imgui.io.WantCaptureMouse = true;
+			}
+
+			UpdateView();
+		}
+
+		ImDrawList *draw_list = ImGui::GetBackgroundDrawList();
+		static const float thickness = 1.0f;
+
+		const ImVec2 view_a = ScreenSpaceToMapSpace(work_pos);
+		const ImVec2 view_b = ScreenSpaceToMapSpace(ImVec2(work_pos.x + work_size.x, work_pos.y + work_size.y));
+
+		const float view_min_x = std::min(view_a.x, view_b.x);
+		const float view_min_y = std::min(view_a.y, view_b.y);
+		const float view_max_x = std::max(view_a.x, view_b.x);
+		const float view_max_y = std::max(view_a.y, view_b.y);
+
+		const float pixels_per_unit = zoom * ZOOM_BASE;
+
+		// Double the grid step until lines are far enough apart to be worth drawing,
+		// and only cover the part of the grid that's on screen.
+		float grid_step = GRID_STEP;
+		while (grid_step * pixels_per_unit < GRID_MIN_PIXELS)
+		{
+			grid_step *= 2.0f;
+		}
+
+		const float grid_x0 = std::max(GRID_MIN, floorf(view_min_x / grid_step) * grid_step);
+		const float grid_x1 = std::min(GRID_MAX, view_max_x);
+		const float grid_y0 = std::max(GRID_MIN, floorf(view_min_y / grid_step) * grid_step);
+		const float grid_y1 = std::min(GRID_MAX, view_max_y);
+
+		for (float x = grid_x0; x <= grid_x1; x += grid_step)
+		{
+			draw_list->AddLine(
+				MapSpaceToScreenSpace(ImVec2(x, grid_y0)),
+				MapSpaceToScreenSpace(ImVec2(x, grid_y1)),
+				IM_COL32(200, 200, 200, 40),
+				thickness * 0.5f
+			);
+		}
+
+		for (float y = grid_y0; y <= grid_y1; y += grid_step)
+		{
+			draw_list->AddLine(
+				MapSpaceToScreenSpace(ImVec2(grid_x0, y)),
+				MapSpaceToScreenSpace(ImVec2(grid_x1, y)),
+				IM_COL32(200, 200, 200, 40),
+				thickness * 0.5f
+			);
+		}
+
+		if (cur_map != nullptr && cur_map->loaded == true
+			&& use_gpu_map == true && map_renderer.valid == true)
+		{
+			// Geometry is already on the GPU, so this is only the view transform
+			const float scale = view.scale;
+			const ImVec2 center = ImVec2(view.offset_x, view.offset_y);
+
+			map_renderer.Upload(cur_map.get());
+			map_renderer.transform[0] = scale * 2.0f / imgui.io.DisplaySize.x;
+			map_renderer.transform[1] = scale * 2.0f / imgui.io.DisplaySize.y;
+			map_renderer.transform[2] = (center.x * 2.0f / imgui.io.DisplaySize.x) - 1.0f;
+			map_renderer.transform[3] = 1.0f - (center.y * 2.0f / imgui.io.DisplaySize.y);
+			map_renderer.pixel_size = 1.0f / (scale * imgui.io.DisplayFramebufferScale.x);
+			map_renderer.Submit(draw_list);
+		}
+		else if (cur_map != nullptr && cur_map->loaded == true)
+		{
+			// Cull against the biggest thing there is; the rest just overdraw a little
+			static constexpr float THING_RADIUS = thing_types_c::MaxRadius();
+
+			line_density.Reset(work_pos, work_size);
+			thing_density.Reset(work_pos, work_size);
+
+			// Only submit what overlaps the visible part of the map
+			const map_columns_c &columns = cur_map->columns;
+
+			line_batch.Clear();
+			cur_map->grid.ForEachLine(columns,
+				view_min_x, view_min_y, view_max_x, view_max_y,
+				[&](uint32_t i)
+			{
+				line_batch.AddSegment(i, columns.LineStart(i), columns.LineEnd(i));
+			});
+
+			view.ProjectSegments(line_batch, 0.0f);
+
+			for (int k = 0; k < line_batch.Count(); ++k)
+			{
+				if (line_batch.visible[k] == 0)
+				{
+					continue;
+				}
+
+				const auto &line = cur_map->linedefs[line_batch.ids[k]];
+
+				const ImVec2 screen_a = line_batch.Start(k);
+				const ImVec2 screen_b = line_batch.End(k);
+
+				if (fabsf(screen_a.x - screen_b.x) < 1.0f && fabsf(screen_a.y - screen_b.y) < 1.0f)
+				{
+					// Shorter than a pixel; merge it with anything else landing there
+					line_density.Add(screen_a);
+					continue;
+				}
+
+				float trans = 1.0f;
+
+				if ((line.flags & 1) == 0)
+				{
+					trans *= 0.5f;
+				}
+
+				draw_list->AddLine(
+					screen_a,
+					screen_b,
+					IM_COL32(200, 200, 200, 200 * trans),
+					thickness
+				);
+			}
+
+			thing_batch.Clear();
+			cur_map->grid.ForEachThing(columns,
+				view_min_x - THING_RADIUS, view_min_y - THING_RADIUS,
+				view_max_x + THING_RADIUS, view_max_y + THING_RADIUS,
+				[&](uint32_t i)
+			{
+				thing_batch.AddPoint(i, columns.Thing(i));
+			});
+
+			view.ProjectPoints(thing_batch, THING_RADIUS * pixels_per_unit);
+
+			for (int k = 0; k < thing_batch.Count(); ++k)
+			{
+				if (thing_batch.visible[k] == 0)
+				{
+					continue;
+				}
+
+				const ImVec2 screen_pos = thing_batch.Start(k);
+				const auto &info = thing_types_c::Info(columns.thing_category[thing_batch.ids[k]]);
+				const float radius_pixels = info.radius * pixels_per_unit;
+
+				if (radius_pixels < 1.0f)
+				{
+					thing_density.Add(screen_pos);
+					continue;
+				}
+
+				draw_list->AddCircleFilled(
+					screen_pos,
+					radius_pixels,
+					info.color
+				);
+			}
+
+			line_density.Flush(draw_list, 200, 200, 200, 100, 200);
+			thing_density.Flush(draw_list, 200, 200, 200, 120, 230);
+		}
+	}
+
+	void RectMoveByHandles(ImVec2 *top_left, ImVec2 *bottom_right, const int handle, const ImVec2 &delta)
+	{
+		if (handle & GRAB_LEFT)
+		{
+			top_left->x += delta.x / zoom / ZOOM_BASE;
+		}
+
+		if (handle & GRAB_TOP)
+		{
+			top_left->y += delta.y / zoom / ZOOM_BASE;
+		}
+
+		if (handle & GRAB_RIGHT)
+		{
+			bottom_right->x += delta.x / zoom / ZOOM_BASE;
+		}
+
+		if (handle & GRAB_BOTTOM)
+		{
+			bottom_right->y += delta.y / zoom / ZOOM_BASE;
+		}
+	}
+
+	void DrawRegionShape(ImDrawList *draw_list, const region_shape_c &shape, ImU32 fill_color, ImU32 line_color)
+	{
+		shape_batch.Clear();
+
+		// Each trapezoid goes in as its two diagonals. Between them they have all four
+		// corners, and the trapezoid is on screen if either diagonal's bounding box is.
+		for (size_t i = 0; i < shape.fill_trapezoids.size(); ++i)
+		{
+			const auto &trapezoid = shape.fill_trapezoids[i];
+			shape_batch.AddSegment((uint32_t)i, ImVec2(trapezoid.left0, trapezoid.y0), ImVec2(trapezoid.right1, trapezoid.y1));
+			shape_batch.AddSegment((uint32_t)i, ImVec2(trapezoid.right0, trapezoid.y0), ImVec2(trapezoid.left1, trapezoid.y1));
+		}
+
+		const int fill_count = shape_batch.Count();
+
+		for (size_t i = 0; i < shape.edges.size(); ++i)
+		{
+			shape_batch.AddSegment((uint32_t)i, shape.edges[i].a, shape.edges[i].b);
+		}
+
+		view.ProjectSegments(shape_batch, 0.0f);
+
+		// Neighbouring trapezoids share their sides, and antialiasing would leave a faint seam down them
+		const ImDrawListFlags old_flags = draw_list->Flags;
+		draw_list->Flags &= ~ImDrawListFlags_AntiAliasedFill;
+
+		for (int k = 0; k < fill_count; k += 2)
+		{
+			if (shape_batch.visible[k] == 0 && shape_batch.visible[k + 1] == 0)
+			{
+				continue;
+			}
+
+			draw_list->AddQuadFilled(shape_batch.Start(k), shape_batch.Start(k + 1), shape_batch.End(k), shape_batch.End(k + 1), fill_color);
+		}
+
+		draw_list->Flags = old_flags;
+
+		for (int k = fill_count; k < shape_batch.Count(); ++k)
+		{
+			if (shape_batch.visible[k] == 0)
+			{
+				continue;
+			}
+
+			draw_list->AddLine(shape_batch.Start(k), shape_batch.End(k), line_color);
+		}
+	}
+
+	// Moving, adding and removing the selected polygon's points. Drag a point to move it,
+	// right click one to remove it, or double click on an edge to add one there.
+	void EditPolygon(float border_size)
+	{
+		static int grabbed_point = -1;
+
+		if (imgui.io.WantCaptureMouse == true
+			|| selected_region_id < 0 || selected_region_id >= (int)regions.size()
+			|| regions[selected_region_id].polygon.size() < 3)
+		{
+			grabbed_point = -1;
+			return;
+		}
+
+		auto &region = regions[selected_region_id];
+		const ImVec2 mouse = ImGui::GetMousePos();
+
+		// The shape as it was, for the undo history. Most frames don't edit anything,
+		// so it's only copied once an edit starts.
+		std::vector<ImVec2> before_polygon;
+		ImVec2 before_a, before_b;
+		bool changed = false;
+
+		auto begin_edit = [&]()
+		{
+			before_polygon = region.polygon;
+			before_a = region.rect_vertex_a;
+			before_b = region.rect_vertex_b;
+			changed = true;
+		};
+
+		if (ImGui::IsMouseDragging(ImGuiMouseButton_Left) && grabbed_point >= 0 && grabbed_point < (int)region.polygon.size())
+		{
+			begin_edit();
+			region.polygon[grabbed_point] = ScreenSpaceToMapSpace(mouse);
+		}
+		else
+		{
+			grabbed_point = -1;
+
+			// Project every edge clipped to the area around the cursor; only the edges
+			// that pass can have a point or a stretch near enough to grab.
+			polygon_batch.Clear();
+			for (int i = 0, len = (int)region.polygon.size(); i < len; ++i)
+			{
+				polygon_batch.AddSegment(i, region.polygon[i], region.polygon[(i + 1) % len]);
+			}
+
+			view.Around(mouse, border_size * 0.5f).ProjectSegments(polygon_batch, 0.0f);
+
+			for (int i = 0; i < polygon_batch.Count(); ++i)
+			{
+				const ImVec2 screen = polygon_batch.Start(i);
+				if (polygon_batch.visible[i] == 1
+					&& fabsf(screen.x - mouse.x) <= border_size * 0.5f && fabsf(screen.y - mouse.y) <= border_size * 0.5f)
+				{
+					grabbed_point = i;
+					break;
+				}
+			}
+
+			if (grabbed_point >= 0 && ImGui::IsMouseClicked(ImGuiMouseButton_Right) && region.polygon.size() > 3)
+			{
+				begin_edit();
+				region.polygon.erase(region.polygon.begin() + grabbed_point);
+				grabbed_point = -1;
+			}
+			else if (grabbed_point < 0 && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+			{
+				// Find the edge closest to the cursor, in screen space
+				int best_edge = -1;
+				float best_distance = border_size * 0.5f;
+
+				for (int i = 0; i < polygon_batch.Count(); ++i)
+				{
+					if (polygon_batch.visible[i] == 0)
+					{
+						continue;
+					}
+
+					const ImVec2 a = polygon_batch.Start(i);
+					const ImVec2 b = polygon_batch.End(i);
+					const ImVec2 ab(b.x - a.x, b.y - a.y);
+					const float length_sq = ab.x * ab.x + ab.y * ab.y;
+					const float t = (length_sq > 0.0f) ? std::clamp(((mouse.x - a.x) * ab.x + (mouse.y - a.y) * ab.y) / length_sq, 0.0f, 1.0f) : 0.0f;
+					const float distance = hypotf(a.x + ab.x * t - mouse.x, a.y + ab.y * t - mouse.y);
+
+					if (distance < best_distance)
+					{
+						best_distance = distance;
+						best_edge = i;
+					}
+				}
+
+				if (best_edge >= 0)
+				{
+					begin_edit();
+					region.polygon.insert(region.polygon.begin() + best_edge + 1, ScreenSpaceToMapSpace(mouse));
+				}
+			}
+		}
+
+		if (changed == true)
+		{
+			region.BuildShape(nullptr);
+			history.RecordShape(selected_region_id, before_polygon, region.sector_ids, before_a, before_b, region);
+			MarkRegionsChanged(selected_region_id);
+		}
+
+		if (grabbed_point >= 0 || changed == true)
+		{
+			ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeAll);
+			imgui.io.WantCaptureMouse = true;
+		}
+	}
+
+	void DrawRegions(void)
+	{
+		static ImGuiWindowFlags region_flags = ( ImGuiWindowFlags_NoTitleBar
+			| ImGuiWindowFlags_NoScrollbar
+			| ImGuiWindowFlags_NoCollapse
+			| ImGuiWindowFlags_NoSavedSettings
+			| ImGuiWindowFlags_NoFocusOnAppearing
+			| ImGuiWindowFlags_NoNav
+		);
+		static const float BORDER_SIZE = GRID_STEP * 0.25;
+		static int handle = GRAB_NULL;
+
+		ImDrawList *draw_list = ImGui::GetBackgroundDrawList();
+
+		EditPolygon(BORDER_SIZE);
+
+		// Regions made of sectors follow the map, so they can't be dragged
+		if (imgui.io.WantCaptureMouse == false
+			&& (selected_region_id >= 0 && selected_region_id < (int)regions.size())
+			&& regions[selected_region_id].sector_ids.size() == 0)
+		{
+			auto &region = regions[selected_region_id];
+
+			ImVec2 top_left = MapSpaceToScreenSpace(ImVec2(region.rect_vertex_a.x, -region.rect_vertex_a.y));
+			ImVec2 bottom_right = MapSpaceToScreenSpace(ImVec2(region.rect_vertex_b.x, -region.rect_vertex_b.y));
+
+			if (ImGui::IsMouseDragging(ImGuiMouseButton_Left)
+				&& handle != GRAB_NULL)
+			{
+				// Update
+				const ImVec2 before_a = region.rect_vertex_a;
+				const ImVec2 before_b = region.rect_vertex_b;
+
+				RectMoveByHandles(
+					&region.rect_vertex_a,
+					&region.rect_vertex_b,
+					handle,
+					ImGui::GetMouseDragDelta(ImGuiMouseButton_Left)
+				);
+				region.FitPolygonToRect(before_a, before_b);
+				history.RecordRect(selected_region_id, before_a, before_b, region.rect_vertex_a, region.rect_vertex_b);
+				MarkRegionsChanged(selected_region_id);
+				ImGui::ResetMouseDragDelta();
+				imgui.io.WantCaptureMouse = true;
+			}
+			else if (ImGui::IsMouseHoveringRect(
+				ImVec2(top_left.x - BORDER_SIZE, top_left.y - BORDER_SIZE),
+				ImVec2(bottom_right.x + BORDER_SIZE, bottom_right.y + BORDER_SIZE),
+				false))
+			{
+				if (ImGui::IsMouseHoveringRect(
+					ImVec2(top_left.x + BORDER_SIZE, top_left.y + BORDER_SIZE),
+					ImVec2(bottom_right.x - BORDER_SIZE, bottom_right.y - BORDER_SIZE),
+					false))
+				{
+					// Drag the entire thing
+					handle = GRAB_ALL;
+				}
+				else
+				{
+					// Stretch specific handle
+					ImVec2 cursor = ImGui::GetMousePos();
+
+					ImVec2 center = ImVec2(
+						(top_left.x + bottom_right.x) * 0.5f,
+						(top_left.y + bottom_right.y) * 0.5f
+					);
+
+					ImVec2 dist = ImVec2(
+						abs(top_left.x - center.x),
+						abs(top_left.y - center.y)
+					);
+					ImVec2 detect_handle = ImVec2(
+						(cursor.x - center.x) / dist.x,
+						(cursor.y - center.y) / dist.y
+					);
+
+					static const float HANDLE_DIST = 0.85f;
+					handle = GRAB_NULL;
+
+					if (detect_handle.x < -HANDLE_DIST)
+					{
+						handle |= GRAB_LEFT;
+					}
+					else if (detect_handle.x > HANDLE_DIST)
+					{
+						handle |= GRAB_RIGHT;
+					}
+
+					if (detect_handle.y < -HANDLE_DIST)
+					{
+						handle |= GRAB_TOP;
+					}
+					else if (detect_handle.y > HANDLE_DIST)
+					{
+						handle |= GRAB_BOTTOM;
+					}
+				}
+
+				imgui.io.WantCaptureMouse = true;
+			}
+			else
+			{
+				handle = GRAB_NULL;
+			}
+		}
+		else
+		{
+			handle = GRAB_NULL;
+		}
+
+		switch (handle)
+		{
+			case GRAB_TOP:
+			case GRAB_BOTTOM:
+			{
+				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNS);
+				break;
+			}
+			case GRAB_LEFT:
+			case GRAB_RIGHT:
+			{
+				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeEW);
+				break;
+			}
+			case (GRAB_TOP|GRAB_LEFT):
+			case (GRAB_BOTTOM|GRAB_RIGHT):
+			{
+				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNWSE);
+				break;
+			}
+			case (GRAB_TOP|GRAB_RIGHT):
+			case (GRAB_BOTTOM|GRAB_LEFT):
+			{
+				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNESW);
+				break;
+			}
+			case GRAB_ALL:
+			{
+				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeAll);
+				break;
+			}
+		}
+
+		const region_index_c &index = RegionIndex();
+
+		// Only look at regions that are on screen, or near enough the cursor to be hovered
+		const ImVec2 view_a = ScreenSpaceToMapSpace(work_pos);
+		const ImVec2 view_b = ScreenSpaceToMapSpace(ImVec2(work_pos.x + work_size.x, work_pos.y + work_size.y));
+
+		const float border = BORDER_SIZE / view.scale;
+
+		visible_regions.clear();
+		index.ForEachInRect(std::min(view_a.x, view_b.x) - border, std::min(view_a.y, view_b.y) - border,
+			std::max(view_a.x, view_b.x) + border, std::max(view_a.y, view_b.y) + border,
+			[&](int region_id) { visible_regions.push_back(region_id); });
+
+		// Draw bottom to top, so the lowest id ends up on top
+		std::sort(visible_regions.begin(), visible_regions.end(), std::greater<int>());
+
+		// Project every candidate's corners in one go; both hovering and drawing use them
+		region_batch.Clear();
+		for (int i : visible_regions)
+		{
+			const auto &region = regions[i];
+			ImVec2 top_left = ImVec2(region.rect_vertex_a.x, -region.rect_vertex_a.y);
+
+			if (region.shape != nullptr)
+			{
+				// Bounds are kept normalized for shapes, so this is always the top-left corner
+				top_left = ImVec2(region.shape->min.x, region.shape->max.y);
+			}
+
+			region_batch.AddSegment(i, top_left, ImVec2(region.rect_vertex_b.x, -region.rect_vertex_b.y));
+		}
+
+		view.ProjectSegments(region_batch, BORDER_SIZE);
+
+		const ImVec2 mouse = ImGui::GetMousePos();
+		const ImVec2 cursor = ScreenSpaceToMapSpace(mouse);
+
+		int hovered_region_id = -1;
+		bool selected_hovered = false;
+
+		for (int k = 0; k < region_batch.Count(); ++k)
+		{
+			const int region_id = (int)region_batch.ids[k];
+			const ImVec2 a = region_batch.Start(k);
+			const ImVec2 b = region_batch.End(k);
+
+			if (region_batch.visible[k] == 0
+				|| mouse.x < std::min(a.x, b.x) - BORDER_SIZE || mouse.x > std::max(a.x, b.x) + BORDER_SIZE
+				|| mouse.y < std::min(a.y, b.y) - BORDER_SIZE || mouse.y > std::max(a.y, b.y) + BORDER_SIZE)
+			{
+				continue;
+			}
+
+			// Boxes get some slack around their edges for the handles; shapes don't have any
+			if (index.HasShape(region_id) == true && index.Contains(region_id, cursor.x, cursor.y) == false
+				&& region_id != selected_region_id)
+			{
+				continue;
+			}
+
+			if (hovered_region_id < 0 || region_id < hovered_region_id)
+			{
+				hovered_region_id = region_id;
+			}
+
+			selected_hovered = selected_hovered || (region_id == selected_region_id);
+		}
+
+		if (imgui.io.WantCaptureMouse == false && hovered_region_id >= 0)
+		{
+			if (handle == GRAB_NULL)
+			{
+				ImGui::SetMouseCursor(ImGuiMouseCursor_Hand);
+			}
+
+			if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+			{
+				selected_region_id = hovered_region_id;
+				imgui.io.WantCaptureMouse = true;
+			}
+		}
+
+		// After this frame's edits, so the shading matches what's drawn
+		if (show_reachability == true)
+		{
+			UpdateReachability();
+		}
+
+		for (int k = 0; k < region_batch.Count(); ++k)
+		{
+			if (region_batch.visible[k] == 0)
+			{
+				continue;
+			}
+
+			const int i = (int)region_batch.ids[k];
+			auto &region = regions[i];
+
+			float trans = 1.0f;
+			bool highlight = (i == selected_region_id) ? selected_hovered
+				: (i == hovered_region_id && imgui.io.WantCaptureMouse == false);
+
+			if (show_reachability == true && reachability.IsReachable(i) == false)
+			{
+				trans *= 0.35f;
+			}
+
+			const ImVec2 top_left = region_batch.Start(k);
+			const ImVec2 bottom_right = region_batch.End(k);
+
+			float rect_color[3];
+			rect_color[0] = region.rect_color[0] * 0.8f;
+			rect_color[1] = region.rect_color[1] * 0.8f;
+			rect_color[2] = region.rect_color[2] * 0.8f;
+
+			if (highlight == true)
+			{
+				rect_color[0] = std::min(rect_color[0] + 0.5f, 1.0f);
+				rect_color[1] = std::min(rect_color[1] + 0.5f, 1.0f);
+				rect_color[2] = std::min(rect_color[2] + 0.5f, 1.0f);
+			}
+
+			const ImU32 fill_color = IM_COL32(255 * rect_color[0], 255 * rect_color[1], 255 * rect_color[2], 100 * trans);
+			const ImU32 line_color = IM_COL32(255 * rect_color[0], 255 * rect_color[1], 255 * rect_color[2], 200 * trans);
+
+			if (region.shape != nullptr)
+			{
+				DrawRegionShape(draw_list, *region.shape, fill_color, line_color);
+
+				if (i == selected_region_id && region.polygon.size() >= 3)
+				{
+					const float half = BORDER_SIZE * 0.25f;
+					for (const auto &point : region.polygon)
+					{
+						const ImVec2 screen = MapSpaceToScreenSpace(point);
+						draw_list->AddRectFilled(ImVec2(screen.x - half, screen.y - half), ImVec2(screen.x + half, screen.y + half), IM_COL32_WHITE);
+					}
+				}
+			}
+			else
+			{
+				draw_list->AddRectFilled(top_left, bottom_right, fill_color);
+				draw_list->AddRect(top_left, bottom_right, line_color);
+			}
+
+			draw_list->AddText(
+				ImVec2(top_left.x + (BORDER_SIZE * 0.5), top_left.y + (BORDER_SIZE * 0.5)),
+				IM_COL32_WHITE,
+				region.title.c_str()
+			);
+		}
+	}
+
+	void DrawMenuBar(void)
+	{
+		if (ImGui::BeginMainMenuBar())
+		{
+			if (ImGui::BeginMenu("File"))
+			{
+				ImGui::MenuItem("(demo menu)", NULL, false, false);
+				if (ImGui::MenuItem("New")) {}
+				ImGui::InputText("Project", &project_path);
+				if (ImGui::MenuItem("Open", "Ctrl+O", false, project_path.size() > 0))
+				{
+					OpenProject();
+				}
+				if (ImGui::BeginMenu("Open Recent"))
+				{
+					ImGui::MenuItem("fish_hat.c");
+					ImGui::MenuItem("fish_hat.inl");
+					ImGui::MenuItem("fish_hat.h");
+					if (ImGui::BeginMenu("More.."))
+					{
+						ImGui::MenuItem("Hello");
+						ImGui::MenuItem("Sailor");
+						ImGui::EndMenu();
+					}
+					ImGui::EndMenu();
+				}
+				if (ImGui::MenuItem("Save", "Ctrl+S", false, project_path.size() > 0))
+				{
+					SaveProject();
+				}
+				ImGui::MenuItem("Autosave", nullptr, &autosave);
+				if (project_saver.failures > 0)
+				{
+					ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%d saves failed, see the console", project_saver.failures.load());
+				}
+				if (ImGui::MenuItem("Export Regions", nullptr, false, cur_map != nullptr))
+				{
+					ExportRegions();
+				}
+
+				ImGui::Separator();
+				if (ImGui::BeginMenu("Options"))
+				{
+					static bool enabled = true;
+					ImGui::MenuItem("Enabled", "", &enabled);
+					ImGui::BeginChild("child", ImVec2(0, 60), true);
+					for (int i = 0; i < 10; i++)
+						ImGui::Text("Scrolling Text %d", i);
+					ImGui::EndChild();
+					static float f = 0.5f;
+					static int n = 0;
+					ImGui::SliderFloat("Value", &f, 0.0f, 1.0f);
+					ImGui::InputFloat("Input", &f, 0.1f);
+					ImGui::Combo("Combo", &n, "Yes\0No\0Maybe\0\0");
+					ImGui::EndMenu();
+				}
+				if (ImGui::BeginMenu("Colors"))
+				{
+					float sz = ImGui::GetTextLineHeight();
+					for (int i = 0; i < ImGuiCol_COUNT; i++)
+					{
+						const char* name = ImGui::GetStyleColorName((ImGuiCol)i);
+						ImVec2 p = ImGui::GetCursorScreenPos();
+						ImGui::GetWindowDrawList()->AddRectFilled(p, ImVec2(p.x + sz, p.y + sz), ImGui::GetColorU32((ImGuiCol)i));
+						ImGui::Dummy(ImVec2(sz, sz));
+						ImGui::SameLine();
+						ImGui::MenuItem(name);
+					}
+					ImGui::EndMenu();
+				}
+				if (ImGui::MenuItem("Checked", NULL, true)) {}
+				ImGui::Separator();
+				if (ImGui::MenuItem("Quit", "Alt+F4")) {}
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Edit"))
+			{
+				if (ImGui::MenuItem("Undo", "CTRL+Z", false, history.CanUndo()))
+				{
+					Undo();
+				}
+				if (ImGui::MenuItem("Redo", "CTRL+Y", false, history.CanRedo()))
+				{
+					Redo();
+				}
+
+				int budget_kb = (int)(history.budget_bytes / 1024);
+				if (ImGui::InputInt("History (KB)", &budget_kb, 256, 1024))
+				{
+					history.budget_bytes = (size_t)std::max(1, budget_kb) * 1024;
+					history.Trim();
+				}
+				ImGui::Text("%d steps, %.1f KB", (int)history.undo_list.size(), history.used_bytes / 1024.0f);
+
+				ImGui::Separator();
+				if (ImGui::MenuItem("Cut", "CTRL+X")) {}
+				if (ImGui::MenuItem("Copy", "CTRL+C")) {}
+				if (ImGui::MenuItem("Paste", "CTRL+V")) {}
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("View"))
+			{
+				ImGui::MenuItem("GPU Map Geometry", nullptr, &use_gpu_map, map_renderer.valid);
+				ImGui::Separator();
+				ImGui::MenuItem("Event-Driven Redraw", nullptr, &event_driven);
+				ImGui::SliderInt("Frame Rate Cap", &frame_rate_cap, 0, 240, (frame_rate_cap > 0) ? "%d" : "Off");
+				ImGui::Separator();
+				ImGui::MenuItem("Reachability", nullptr, &show_reachability);
+				ImGui::MenuItem("Seed Generator", nullptr, &show_seed_generator);
+				ImGui::MenuItem("Profiler", nullptr, &show_profiler);
+				ImGui::MenuItem("ImGui Demo", nullptr, &show_demo_window);
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::BeginMenu("Map"))
+			{
+				ImGui::InputText("WAD", &wad_path);
+				ImGui::InputText("Map", &map_name);
+
+				if (ImGui::MenuItem("Load", nullptr, false, wad_path.size() > 0 && map_name.size() > 0))
+				{
+					RequestMap(wad_path, map_name);
+				}
+
+				if (cur_map != nullptr && cur_map->wad->map_markers.size() > 0)
+				{
+					ImGui::Separator();
+
+					for (int marker : cur_map->wad->map_markers)
+					{
+						std::string marker_name = cur_map->wad->lump_name(marker);
+						if (ImGui::MenuItem(marker_name.c_str(), nullptr, marker_name == cur_map->name))
+						{
+							wad_path = cur_map->wad->path;
+							map_name = marker_name;
+							RequestMap(wad_path, map_name);
+						}
+					}
+				}
+
+				ImGui::EndMenu();
+			}
+
+			if (map_loader.busy == true)
+			{
+				ImGui::Separator();
+				ImGui::Text("Loading %s...", map_loader.loading_name.c_str());
+				ImGui::ProgressBar(map_loader.Progress(), ImVec2(160.0f, 0.0f));
+			}
+			else if (cur_map != nullptr)
+			{
+				ImGui::Separator();
+				ImGui::TextDisabled("%s", cur_map->name.c_str());
+			}
+
+			ImGui::EndMainMenuBar();
+		}
+	}
+
+	void DrawProfiler(void)
+	{
+		ImGui::SetNextWindowSize(ImVec2(420.0f, 0.0f), ImGuiCond_FirstUseEver);
+		if (ImGui::Begin("Profiler", &show_profiler))
+		{
+			if (ImGui::BeginTable("stages", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+			{
+				ImGui::TableSetupColumn("Stage");
+				ImGui::TableSetupColumn("Last");
+				ImGui::TableSetupColumn("Min");
+				ImGui::TableSetupColumn("Avg");
+				ImGui::TableSetupColumn("p99");
+				ImGui::TableHeadersRow();
+
+				for (int i = 0; i < profiler_c::STAGE_COUNT; ++i)
+				{
+					const auto stats = profiler.Stats(i);
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextUnformatted(profiler_c::STAGE_NAMES[i]);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f ms", stats.last);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f ms", stats.min);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f ms", stats.avg);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f ms", stats.p99);
+				}
+
+				ImGui::EndTable();
+			}
+
+			ImGui::PlotLines("Frame", profiler.history[profiler_c::STAGE_FRAME], profiler_c::HISTORY_SIZE,
+				profiler.history_pos, nullptr, 0.0f, 33.3f, ImVec2(0.0f, 60.0f));
+
+			ImGui::Text("Draw lists: %d", profiler.draw_lists);
+			ImGui::Text("Draw commands: %d (map: %d)", profiler.draw_commands, profiler.background_commands);
+			ImGui::Text("Vertices: %d (map: %d)", profiler.draw_vertices, profiler.background_vertices);
+			ImGui::Text("Indices: %d", profiler.draw_indices);
+			ImGui::Text("Projection kernel: %s", screen_projection_c::Kernel().name);
+
+			ImGui::Separator();
+
+			if (profiler.tracing == false)
+			{
+				if (ImGui::Button("Start Trace"))
+				{
+					profiler.StartTrace();
+				}
+			}
+			else
+			{
+				if (ImGui::Button("Stop and Save Trace"))
+				{
+					profiler.WriteTrace("srb2aplogic_trace.json");
+				}
+
+				ImGui::SameLine();
+				ImGui::Text("%zu events", profiler.trace_events.size());
+			}
+		}
+		ImGui::End();
+	}
+
+	// Renames the region if its title is already taken. The region's old title,
+	// if it had one, must have been released from region_titles first.
+	void ValidateRegionTitle(region_c &region)
+	{
+		region.title = region_titles.Claim(region.title);
+	}
+
+	static edit_history_c::rule_state_e RuleState(const region_c &region, const std::string &rule_name)
+	{
+		auto it = region.rules.find(rule_name);
+		if (it == region.rules.end())
+		{
+			return edit_history_c::RULE_ABSENT;
+		}
+
+		return (it->second == true) ? edit_history_c::RULE_ON : edit_history_c::RULE_OFF;
+	}
+
+	void DrawRuleEditor(region_c &region)
+	{
+		ImGui::SeparatorText("Rules");
+
+		bool changed = false;
+		std::string remove_rule;
+
+		for (auto &[rule_name, enabled] : region.rules)
+		{
+			ImGui::PushID(rule_name.c_str());
+
+			if (ImGui::Checkbox(rule_name.c_str(), &enabled))
+			{
+				history.RecordRule(selected_region_id, rule_name,
+					enabled ? edit_history_c::RULE_OFF : edit_history_c::RULE_ON,
+					enabled ? edit_history_c::RULE_ON : edit_history_c::RULE_OFF);
+				changed = true;
+			}
+
+			ImGui::SameLine();
+			if (ImGui::SmallButton("Remove"))
+			{
+				remove_rule = rule_name;
+			}
+
+			ImGui::PopID();
+		}
+
+		if (remove_rule.size() > 0)
+		{
+			history.RecordRule(selected_region_id, remove_rule, RuleState(region, remove_rule), edit_history_c::RULE_ABSENT);
+			region.rules.erase(remove_rule);
+			changed = true;
+		}
+
+		if (region.unresolved_rules > 0)
+		{
+			ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Too many distinct items in the project;");
+			ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "this region can never be entered.");
+		}
+
+		static std::string rule_input = "";
+		ImGui::InputText("##new_rule", &rule_input);
+		ImGui::SameLine();
+
+		if (ImGui::Button("Add Rule") && rule_input.size() > 0)
+		{
+			history.RecordRule(selected_region_id, rule_input, RuleState(region, rule_input), edit_history_c::RULE_ON);
+			region.rules[rule_input] = true;
+			rule_input.clear();
+			changed = true;
+		}
+
+		if (changed == true)
+		{
+			region.CompileRules();
+			MarkRegionsChanged(selected_region_id);
+		}
+	}
+
+	// Writes <map>.regions.json to the working directory, for use with --batch
+	void ExportRegions(void)
+	{
+		region_file_c region_file;
+		region_file.wad_path = cur_map->wad->path;
+		region_file.map_name = cur_map->name;
+		region_file.regions = regions;
+
+		std::string path = cur_map->name + ".regions.json";
+		if (region_file.Save(path.c_str()) == true)
+		{
+			printf("Exported %d regions to %s\n", (int)regions.size(), path.c_str());
+		}
+	}
+
+	// Only copies the regions edited since the last snapshot; the rest are shared with it.
+	std::shared_ptr<const region_snapshot_c> SnapshotRegions(void)
+	{
+		if (regions_snapshot == nullptr || regions_snapshot_revision != regions_revision)
+		{
+			regions_snapshot = region_snapshot_c::Take(regions_snapshot.get(), regions);
+			regions_snapshot_revision = regions_revision;
+		}
+
+		return regions_snapshot;
+	}
+
+	project_saver_c::job_s ProjectSaveJob(const std::string &path, bool write_json)
+	{
+		if (regions_map_name.size() > 0)
+		{
+			return { path, regions_wad_path, regions_map_name, SnapshotRegions(), write_json };
+		}
+
+		const std::string &project_wad = (cur_map != nullptr) ? cur_map->wad->path : wad_path;
+		const std::string &project_map = (cur_map != nullptr) ? cur_map->name : map_name;
+		return { path, project_wad, project_map, SnapshotRegions(), write_json };
+	}
+
+	// Writes the binary project, plus a JSON copy of it next to it for diffing
+	void SaveProject(void)
+	{
+		project_saver.Queue(ProjectSaveJob(project_path, true));
+		autosave_revision = regions_revision;
+	}
+
+	// Writes <project>.autosave in the background, at most once per interval,
+	// and only when regions have changed since the last save.
+	void Autosave(void)
+	{
+		if (autosave == false || project_path.size() == 0 || autosave_revision == regions_revision)
+		{
+			return;
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		if (now - last_autosave < AUTOSAVE_INTERVAL)
+		{
+			return;
+		}
+
+		project_saver.Queue(ProjectSaveJob(project_path + ".autosave", false));
+		autosave_revision = regions_revision;
+		last_autosave = now;
+	}
+
+	void OpenProject(void)
+	{
+		project_file_c project;
+		if (project.Open(project_path.c_str()) == false)
+		{
+			return;
+		}
+
+		std::string project_wad(project.String(project.header.wad_path));
+		std::string project_map(project.String(project.header.map_name));
+
+		project.ReadRegions(regions);
+		regions_wad_path = project_wad;
+		regions_map_name = project_map;
+		region_titles.Build(regions);
+		history.Clear();
+		selected_region_id = -1;
+		start_region_id = 0;
+
+		// Sector regions stay boxes until the project's map has loaded
+		if (project_map.size() == 0)
+		{
+			AdoptCurrentMap();
+		}
+
+		RebuildRegionShapes();
+		autosave_revision = regions_revision;
+		printf("Opened %d regions from %s\n", (int)regions.size(), project_path.c_str());
+
+		if (project_wad.size() > 0 && project_map.size() > 0
+			&& (cur_map == nullptr || cur_map->wad->path != project_wad || cur_map->name != project_map))
+		{
+			wad_path = project_wad;
+			map_name = project_map;
+			RequestMap(wad_path, map_name);
+		}
+	}
+
+	// Pass the region's id when it's the only one that changed,
+	// so the index can move just that region instead of starting over.
+	void MarkRegionsChanged(int region_id = -1)
+	{
+		const bool index_current = (region_index_revision == regions_revision);
+		const bool counts_current = (thing_counts_revision == regions_revision
+			&& thing_counts_map == cur_map.get() && region_thing_counts.size() == regions.size());
+		regions_revision++;
+
+		if (region_id >= 0 && region_id < (int)regions.size())
+		{
+			regions[region_id].Touch();
+
+			if (index_current == true)
+			{
+				region_index.Update(region_id, regions[region_id]);
+				region_index_revision = regions_revision;
+			}
+
+			// Regions don't hide each other's things, so no other region's count can change
+			if (counts_current == true && cur_map != nullptr)
+			{
+				region_thing_counts[region_id] = CountRegionThings(region_id);
+				thing_counts_revision = regions_revision;
+			}
+		}
+	}
+
+	const region_index_c &RegionIndex(void)
+	{
+		if (region_index_revision != regions_revision)
+		{
+			region_index.Build(regions);
+			region_index_revision = regions_revision;
+		}
+
+		return region_index;
+	}
+
+	// Counts cur_map's things inside the region, only looking at those within its bounds
+	int CountRegionThings(int region_id) const
+	{
+		const auto &region = regions[region_id];
+		ImVec2 min, max;
+		region.MapBounds(min, max);
+
+		int count = 0;
+		cur_map->grid.ForEachThing(cur_map->columns, min.x, min.y, max.x, max.y, [&](uint32_t thing_id)
+		{
+			if (region.ContainsMapPoint(cur_map->columns.thing_x[thing_id], cur_map->columns.thing_y[thing_id]) == true)
+			{
+				count++;
+			}
+		});
+
+		return count;
 	}
 
-	void Frame_Process(void)
+	// Number of cur_map's things inside the region
+	int RegionThingCount(int region_id)
 	{
-		// Rendering
-		ImGui::Render();
+		if (cur_map == nullptr || region_id < 0 || region_id >= (int)regions.size())
+		{
+			return 0;
+		}
 
-		glViewport(0, 0, (int)imgui.io.DisplaySize.x, (int)imgui.io.DisplaySize.y);
-		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+		if (thing_counts_revision != regions_revision || thing_counts_map != cur_map.get()
+			|| region_thing_counts.size() != regions.size())
+		{
+			region_thing_counts.resize(regions.size());
+			for (int i = 0; i < (int)regions.size(); ++i)
+			{
+				region_thing_counts[i] = CountRegionThings(i);
+			}
 
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			thing_counts_revision = regions_revision;
+			thing_counts_map = cur_map.get();
+		}
 
-		SDL_GL_SwapWindow(sdl.window);
+		return region_thing_counts[region_id];
 	}
 
-	ImVec2 MapSpaceToScreenSpace(const ImVec2 &input)
+	// cur_map if it's the map the regions were drawn over, otherwise nullptr
+	const map_c *RegionsMap(void) const
 	{
-		return ImVec2(
-			work_pos.x + (work_size.x * 0.5) + (scroll.x * zoom) + (input.x * zoom * ZOOM_BASE),
-			work_pos.y + (work_size.y * 0.5) + (scroll.y * zoom) + (-input.y * zoom * ZOOM_BASE)
-		);
+		if (cur_map != nullptr && cur_map->loaded == true
+			&& cur_map->wad->path == regions_wad_path && cur_map->name == regions_map_name)
+		{
+			return cur_map.get();
+		}
+
+		return nullptr;
 	}
 
-	void DrawMap(void)
+	// Makes cur_map the regions' map, unless some region is already made of another map's sectors
+	bool AdoptCurrentMap(void)
 	{
-		if (imgui.io.WantCaptureMouse == false)
+		if (cur_map == nullptr || cur_map->loaded == false)
 		{
-			if (imgui.io.MouseWheel != 0.0f)
+			return false;
+		}
+
+		if (RegionsMap() != nullptr)
+		{
+			return true;
+		}
+
+		for (const auto &region : regions)
+		{
+			if (region.sector_ids.size() > 0)
 			{
-				static const float zoomScrollFactor = (1.0f / 8.0f);
-				zoom = std::clamp(
-					zoom + (imgui.io.MouseWheel * zoomScrollFactor * zoom),
-					ZOOM_MIN,
-					ZOOM_MAX
-				);
-				imgui.io.WantCaptureMouse = true;
+				printf("The regions are made of sectors from %s, not %s\n", regions_map_name.c_str(), cur_map->name.c_str());
+				return false;
 			}
+		}
 
-			if (ImGui::IsMouseDragging(ImGuiMouseButton_Right))
+		regions_wad_path = cur_map->wad->path;
+		regions_map_name = cur_map->name;
+		return true;
+	}
+
+	// Regions made of sectors are only shaped while their own map is loaded, and stay boxes otherwise
+	void RebuildRegionShapes(void)
+	{
+		const map_c *map = RegionsMap();
+
+		for (auto &region : regions)
+		{
+			if (region.sector_ids.size() > 0)
 			{
-				scroll.x += imgui.io.MouseDelta.x / zoom;
-				scroll.y += imgui.io.MouseDelta.y / zoom;
-				imgui.io.WantCaptureMouse = true;
+				region.BuildShape(map);
+				region.Touch();
 			}
 		}
 
-		ImDrawList *draw_list = ImGui::GetBackgroundDrawList();
-		static const float thickness = 1.0f;
+		MarkRegionsChanged();
+	}
 
-		for (float x = -32768.0f; x < 32767.0f; x += GRID_STEP)
+	// Switches the selected region between a box, a polygon and a group of sectors
+	void DrawShapeEditor(region_c &region)
+	{
+		ImGui::SeparatorText("Shape");
+
+		const std::vector<ImVec2> before_polygon = region.polygon;
+		const std::vector<int> before_sectors = region.sector_ids;
+		const ImVec2 before_a = region.rect_vertex_a;
+		const ImVec2 before_b = region.rect_vertex_b;
+		bool changed = false;
+
+		if (region.polygon.size() >= 3)
 		{
-			draw_list->AddLine(
-				MapSpaceToScreenSpace(ImVec2(x, GRID_MIN)),
-				MapSpaceToScreenSpace(ImVec2(x, GRID_MAX)),
-				IM_COL32(200, 200, 200, 40),
-				thickness * 0.5f
-			);
+			ImGui::Text("Polygon, %d points", (int)region.polygon.size());
+		}
+		else if (region.sector_ids.size() > 0)
+		{
+			ImGui::Text("%d sectors", (int)region.sector_ids.size());
+		}
+		else
+		{
+			ImGui::Text("Box");
 		}
 
-		for (float y = -32768.0f; y < 32767.0f; y += GRID_STEP)
+		if (region.HasShape() == false && ImGui::Button("Make Polygon"))
 		{
-			draw_list->AddLine(
-				MapSpaceToScreenSpace(ImVec2(GRID_MIN, y)),
-				MapSpaceToScreenSpace(ImVec2(GRID_MAX, y)),
-				IM_COL32(200, 200, 200, 40),
-				thickness * 0.5f
-			);
+			ImVec2 min, max;
+			region.MapBounds(min, max);
+			region.polygon = { ImVec2(min.x, min.y), ImVec2(max.x, min.y), ImVec2(max.x, max.y), ImVec2(min.x, max.y) };
+			region.sector_ids.clear();
+			changed = true;
 		}
 
-		if (cur_map != nullptr && cur_map->loaded == true)
+		// Takes every sector with its middle inside the region
+		if (cur_map != nullptr && region.sector_ids.size() == 0)
 		{
-			for (int i = 0, len = (int)cur_map->linedefs.size(); i < len; ++i)
+			if (region.HasShape() == false)
 			{
-				const auto &line = cur_map->linedefs[i];
-
-				const auto &vertex_a = cur_map->vertices[line.vertex_id_a];
-				const auto &vertex_b = cur_map->vertices[line.vertex_id_b];
+				ImGui::SameLine();
+			}
 
-				float trans = 1.0f;
+			if (ImGui::Button("Snap to Sectors") && AdoptCurrentMap() == true)
+			{
+				const std::vector<ImVec2> centers = cur_map->SectorCenters();
+				std::vector<int> sector_ids;
 
-				if ((line.flags & 1) == 0)
+				for (int i = 0, len = (int)centers.size(); i < len; ++i)
 				{
-					trans *= 0.5f;
+					if (region.ContainsMapPoint(centers[i].x, centers[i].y) == true)
+					{
+						sector_ids.push_back(i);
+					}
 				}
 
-				draw_list->AddLine(
-					MapSpaceToScreenSpace(ImVec2(vertex_a.x, vertex_a.y)),
-					MapSpaceToScreenSpace(ImVec2(vertex_b.x, vertex_b.y)),
-					IM_COL32(200, 200, 200, 200 * trans),
-					thickness
-				);
+				if (sector_ids.size() > 0)
+				{
+					region.polygon.clear();
+					region.sector_ids = std::move(sector_ids);
+					changed = true;
+				}
 			}
+		}
 
-			for (int i = 0, len = (int)cur_map->things.size(); i < len; ++i)
+		if (region.HasShape() == true)
+		{
+			ImGui::SameLine();
+			if (ImGui::Button("Make Box"))
 			{
-				const auto &thing = cur_map->things[i];
-
-				draw_list->AddCircleFilled(
-					MapSpaceToScreenSpace(ImVec2(thing.x, thing.y)),
-					8.0f * zoom * ZOOM_BASE,
-					IM_COL32(200, 200, 200, 200)
-				);
+				region.polygon.clear();
+				region.sector_ids.clear();
+				changed = true;
 			}
 		}
-	}
 
-	void RectMoveByHandles(ImVec2 *top_left, ImVec2 *bottom_right, const int handle, const ImVec2 &delta)
-	{
-		if (handle & GRAB_LEFT)
+		if (changed == true)
 		{
-			top_left->x += delta.x / zoom / ZOOM_BASE;
+			region.BuildShape(RegionsMap());
+			history.RecordShape(selected_region_id, before_polygon, before_sectors, before_a, before_b, region);
+			MarkRegionsChanged(selected_region_id);
 		}
+	}
 
-		if (handle & GRAB_TOP)
+	// Adds the regions region_seeder_c proposes for the current map, as a single undo step
+	void SeedRegionsFromMap(void)
+	{
+		if (AdoptCurrentMap() == false)
 		{
-			top_left->y += delta.y / zoom / ZOOM_BASE;
+			return;
 		}
 
-		if (handle & GRAB_RIGHT)
-		{
-			bottom_right->x += delta.x / zoom / ZOOM_BASE;
-		}
+		std::vector<region_c> seeded = region_seeder_c::Seed(*cur_map);
+		const int first_id = (int)regions.size();
 
-		if (handle & GRAB_BOTTOM)
+		for (auto &seeded_region : seeded)
 		{
-			bottom_right->y += delta.y / zoom / ZOOM_BASE;
+			auto &new_region = regions.emplace_back(std::move(seeded_region));
+			ValidateRegionTitle(new_region);
 		}
+
+		history.RecordAdd(first_id, std::span<const region_c>(regions).subspan(first_id));
+
+		MarkRegionsChanged();
+		printf("Seeded %d regions from %s\n", (int)seeded.size(), cur_map->name.c_str());
 	}
 
-	void DrawRegions(void)
+	void NewRegion(void)
 	{
-		static ImGuiWindowFlags region_flags = ( ImGuiWindowFlags_NoTitleBar
-			| ImGuiWindowFlags_NoScrollbar
-			| ImGuiWindowFlags_NoCollapse
-			| ImGuiWindowFlags_NoSavedSettings
-			| ImGuiWindowFlags_NoFocusOnAppearing
-			| ImGuiWindowFlags_NoNav
-		);
-		static const float BORDER_SIZE = GRID_STEP * 0.25;
-		static int handle = GRAB_NULL;
-
-		ImDrawList *draw_list = ImGui::GetBackgroundDrawList();
+		auto &new_region = regions.emplace_back();
+		ValidateRegionTitle(new_region);
+		history.RecordAdd((int)regions.size() - 1, std::span<const region_c>(&new_region, 1));
+		MarkRegionsChanged();
+	}
 
-		if (imgui.io.WantCaptureMouse == false
-			&& (selected_region_id >= 0 && selected_region_id < (int)regions.size()))
+	// Moves a region to another spot in the list, shuffling the ones between along.
+	void MoveRegion(int from_id, int to_id)
+	{
+		if (from_id < to_id)
 		{
-			auto &region = regions[selected_region_id];
-
-			ImVec2 top_left = MapSpaceToScreenSpace(ImVec2(region.rect_vertex_a.x, -region.rect_vertex_a.y));
-			ImVec2 bottom_right = MapSpaceToScreenSpace(ImVec2(region.rect_vertex_b.x, -region.rect_vertex_b.y));
-
-			if (ImGui::IsMouseDragging(ImGuiMouseButton_Left)
-				&& handle != GRAB_NULL)
-			{
-				// Update
-				RectMoveByHandles(
-					&region.rect_vertex_a,
-					&region.rect_vertex_b,
-					handle,
-					ImGui::GetMouseDragDelta(ImGuiMouseButton_Left)
-				);
-				ImGui::ResetMouseDragDelta();
-				imgui.io.WantCaptureMouse = true;
-			}
-			else if (ImGui::IsMouseHoveringRect(
-				ImVec2(top_left.x - BORDER_SIZE, top_left.y - BORDER_SIZE),
-				ImVec2(bottom_right.x + BORDER_SIZE, bottom_right.y + BORDER_SIZE),
-				false))
-			{
-				if (ImGui::IsMouseHoveringRect(
-					ImVec2(top_left.x + BORDER_SIZE, top_left.y + BORDER_SIZE),
-					ImVec2(bottom_right.x - BORDER_SIZE, bottom_right.y - BORDER_SIZE),
-					false))
-				{
-					// Drag the entire thing
-					handle = GRAB_ALL;
-				}
-				else
-				{
-					// Stretch specific handle
-					ImVec2 cursor = ImGui::GetMousePos();
-
-					ImVec2 center = ImVec2(
-						(top_left.x + bottom_right.x) * 0.5f,
-						(top_left.y + bottom_right.y) * 0.5f
-					);
+			std::rotate(regions.begin() + from_id, regions.begin() + from_id + 1, regions.begin() + to_id + 1);
+		}
+		else if (from_id > to_id)
+		{
+			std::rotate(regions.begin() + to_id, regions.begin() + from_id, regions.begin() + from_id + 1);
+		}
 
-					ImVec2 dist = ImVec2(
-						abs(top_left.x - center.x),
-						abs(top_left.y - center.y)
-					);
-					ImVec2 detect_handle = ImVec2(
-						(cursor.x - center.x) / dist.x,
-						(cursor.y - center.y) / dist.y
-					);
+		// The start region is kept by position, so it has to move along with its region
+		if (start_region_id == from_id)
+		{
+			start_region_id = to_id;
+		}
+		else if (from_id < to_id && start_region_id > from_id && start_region_id <= to_id)
+		{
+			start_region_id--;
+		}
+		else if (from_id > to_id && start_region_id >= to_id && start_region_id < from_id)
+		{
+			start_region_id++;
+		}
 
-					static const float HANDLE_DIST = 0.85f;
-					handle = GRAB_NULL;
+		MarkRegionsChanged();
+	}
 
-					if (detect_handle.x < -HANDLE_DIST)
-					{
-						handle |= GRAB_LEFT;
-					}
-					else if (detect_handle.x > HANDLE_DIST)
-					{
-						handle |= GRAB_RIGHT;
-					}
+	void SetRegionTitle(int region_id, const std::string &title)
+	{
+		auto &region = regions[region_id];
+		region_titles.Release(region.title);
+		region.title = title;
+		ValidateRegionTitle(region);
+	}
 
-					if (detect_handle.y < -HANDLE_DIST)
-					{
-						handle |= GRAB_TOP;
-					}
-					else if (detect_handle.y > HANDLE_DIST)
-					{
-						handle |= GRAB_BOTTOM;
-					}
-				}
+	void SetRegionRule(int region_id, const std::string &rule_name, edit_history_c::rule_state_e state)
+	{
+		auto &region = regions[region_id];
 
-				imgui.io.WantCaptureMouse = true;
-			}
-			else
-			{
-				handle = GRAB_NULL;
-			}
+		if (state == edit_history_c::RULE_ABSENT)
+		{
+			region.rules.erase(rule_name);
 		}
 		else
 		{
-			handle = GRAB_NULL;
+			region.rules[rule_name] = (state == edit_history_c::RULE_ON);
 		}
 
-		switch (handle)
+		region.CompileRules();
+	}
+
+	// Puts one history entry's change into effect, or takes it back out again.
+	void ApplyEdit(const edit_history_c::edit_s &edit, bool forward)
+	{
+		const int len = (int)regions.size();
+		const int region_id = edit.region_id;
+
+		switch (edit.Kind())
 		{
-			case GRAB_TOP:
-			case GRAB_BOTTOM:
-			{
-				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNS);
-				break;
-			}
-			case GRAB_LEFT:
-			case GRAB_RIGHT:
+			case edit_history_c::EDIT_RECT:
 			{
-				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeEW);
+				if (region_id >= len)
+				{
+					return;
+				}
+
+				const auto &rect = std::get<edit_history_c::rect_edit_s>(edit.payload);
+				auto &region = regions[region_id];
+				const ImVec2 old_a = region.rect_vertex_a;
+				const ImVec2 old_b = region.rect_vertex_b;
+
+				region.rect_vertex_a = forward ? rect.after_a : rect.before_a;
+				region.rect_vertex_b = forward ? rect.after_b : rect.before_b;
+				region.FitPolygonToRect(old_a, old_b);
+				MarkRegionsChanged(region_id);
 				break;
 			}
-			case (GRAB_TOP|GRAB_LEFT):
-			case (GRAB_BOTTOM|GRAB_RIGHT):
+
+			case edit_history_c::EDIT_SHAPE:
 			{
-				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNWSE);
+				if (region_id >= len)
+				{
+					return;
+				}
+
+				const auto &shape = std::get<edit_history_c::shape_edit_s>(edit.payload);
+				auto &region = regions[region_id];
+				region.polygon = forward ? shape.after_polygon : shape.before_polygon;
+				region.sector_ids = forward ? shape.after_sectors : shape.before_sectors;
+				region.rect_vertex_a = forward ? shape.rect.after_a : shape.rect.before_a;
+				region.rect_vertex_b = forward ? shape.rect.after_b : shape.rect.before_b;
+				region.BuildShape(RegionsMap());
+				MarkRegionsChanged(region_id);
 				break;
 			}
-			case (GRAB_TOP|GRAB_RIGHT):
-			case (GRAB_BOTTOM|GRAB_LEFT):
+
+			case edit_history_c::EDIT_TITLE:
 			{
-				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNESW);
+				if (region_id >= len)
+				{
+					return;
+				}
+
+				const auto &title = std::get<edit_history_c::title_edit_s>(edit.payload);
+				SetRegionTitle(region_id, forward ? title.after : title.before);
+				MarkRegionsChanged(region_id);
 				break;
 			}
-			case GRAB_ALL:
+
+			case edit_history_c::EDIT_RULE:
 			{
-				ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeAll);
-				break;
-			}
-		}
+				if (region_id >= len)
+				{
+					return;
+				}
 
-		for (int i = (int)regions.size()-1; i >= 0; --i)
-		{
-			auto &region = regions[i];
+				const auto &rule = std::get<edit_history_c::rule_edit_s>(edit.payload);
+				SetRegionRule(region_id, rule.rule_name, forward ? rule.after : rule.before);
+				MarkRegionsChanged(region_id);
+				break;
+			}
 
-			std::string window_id("Region Window##");
-			window_id += std::to_string(i + 1);
+			case edit_history_c::EDIT_MOVE:
+			{
+				const int to_id = std::get<edit_history_c::move_edit_s>(edit.payload).to_id;
+				if (region_id >= len || to_id >= len)
+				{
+					return;
+				}
 
-			float trans = 1.0f;
-			bool highlight = false;
+				if (forward == true)
+				{
+					MoveRegion(region_id, to_id);
+				}
+				else
+				{
+					MoveRegion(to_id, region_id);
+				}
 
-			ImVec2 top_left = MapSpaceToScreenSpace(ImVec2(region.rect_vertex_a.x, -region.rect_vertex_a.y));
-			ImVec2 bottom_right = MapSpaceToScreenSpace(ImVec2(region.rect_vertex_b.x, -region.rect_vertex_b.y));
+				selected_region_id = forward ? to_id : region_id;
+				return;
+			}
 
-			if ((i == selected_region_id || imgui.io.WantCaptureMouse == false)
-				&& ImGui::IsMouseHoveringRect(
-					ImVec2(top_left.x - BORDER_SIZE, top_left.y - BORDER_SIZE),
-					ImVec2(bottom_right.x + BORDER_SIZE, bottom_right.y + BORDER_SIZE),
-					false
-				))
+			case edit_history_c::EDIT_ADD:
 			{
-				highlight = true;
+				const auto &added = std::get<edit_history_c::add_edit_s>(edit.payload).regions;
 
-				if (imgui.io.WantCaptureMouse == false)
+				if (forward == true)
 				{
-					if (handle == GRAB_NULL)
+					if (region_id != len)
 					{
-						ImGui::SetMouseCursor(ImGuiMouseCursor_Hand);
+						return;
 					}
 
-					if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+					for (const auto &added_region : added)
 					{
-						selected_region_id = i;
-						imgui.io.WantCaptureMouse = true;
+						auto &new_region = regions.emplace_back(added_region);
+						ValidateRegionTitle(new_region);
+						new_region.Touch();
 					}
 				}
-			}
+				else
+				{
+					if (region_id + (int)added.size() != len)
+					{
+						return;
+					}
 
-			float rect_color[3];
-			rect_color[0] = region.rect_color[0] * 0.8f;
-			rect_color[1] = region.rect_color[1] * 0.8f;
-			rect_color[2] = region.rect_color[2] * 0.8f;
+					for (size_t i = 0; i < added.size(); ++i)
+					{
+						region_titles.Release(regions.back().title);
+						regions.pop_back();
+					}
 
-			if (highlight == true)
-			{
-				rect_color[0] = std::min(rect_color[0] + 0.5f, 1.0f);
-				rect_color[1] = std::min(rect_color[1] + 0.5f, 1.0f);
-				rect_color[2] = std::min(rect_color[2] + 0.5f, 1.0f);
+					if (selected_region_id >= (int)regions.size())
+					{
+						selected_region_id = -1;
+					}
+
+					// Taking away the start region falls back to the first one, like a fresh project
+					if (start_region_id >= (int)regions.size())
+					{
+						start_region_id = 0;
+					}
+				}
+
+				MarkRegionsChanged();
+				return;
 			}
+		}
 
-			draw_list->AddRectFilled(
-				top_left,
-				bottom_right,
-				IM_COL32(255 * rect_color[0], 255 * rect_color[1], 255 * rect_color[2], 100 * trans)
-			);
-			draw_list->AddRect(
-				top_left,
-				bottom_right,
-				IM_COL32(255 * rect_color[0], 255 * rect_color[1], 255 * rect_color[2], 200 * trans)
-			);
-			draw_list->AddText(
-				ImVec2(top_left.x + (BORDER_SIZE * 0.5), top_left.y + (BORDER_SIZE * 0.5)),
-				IM_COL32_WHITE,
-				region.title.c_str()
-			);
+		selected_region_id = region_id;
+	}
+
+	void Undo(void)
+	{
+		const edit_history_c::edit_s *edit = history.Undo();
+		if (edit != nullptr)
+		{
+			ApplyEdit(*edit, false);
 		}
 	}
 
-	void DrawMenuBar(void)
+	void Redo(void)
 	{
-		if (ImGui::BeginMainMenuBar())
+		const edit_history_c::edit_s *edit = history.Redo();
+		if (edit != nullptr)
 		{
-			if (ImGui::BeginMenu("File"))
+			ApplyEdit(*edit, true);
+		}
+	}
+
+	// Rebuilds if the regions changed, holding onto the same items
+	void UpdateReachability(void)
+	{
+		if (reachability_revision != regions_revision)
+		{
+			reachability.Reset(regions, RegionIndex(), start_region_id, reachability.inventory);
+			reachability_revision = regions_revision;
+		}
+	}
+
+	void DrawReachability(void)
+	{
+		// Usually already done by DrawRegions, unless something changed the regions since
+		UpdateReachability();
+
+		if (ImGui::Begin("Reachability", &show_reachability))
+		{
+			const char *start_title = (start_region_id >= 0 && start_region_id < (int)regions.size())
+				? regions[start_region_id].title.c_str() : "(none)";
+
+			if (ImGui::BeginCombo("Start Region", start_title))
 			{
-				ImGui::MenuItem("(demo menu)", NULL, false, false);
-				if (ImGui::MenuItem("New")) {}
-				if (ImGui::MenuItem("Open", "Ctrl+O")) {}
-				if (ImGui::BeginMenu("Open Recent"))
+				for (int i = 0, len = (int)regions.size(); i < len; ++i)
 				{
-					ImGui::MenuItem("fish_hat.c");
-					ImGui::MenuItem("fish_hat.inl");
-					ImGui::MenuItem("fish_hat.h");
-					if (ImGui::BeginMenu("More.."))
+					ImGui::PushID(i);
+					if (ImGui::Selectable(regions[i].title.c_str(), i == start_region_id))
 					{
-						ImGui::MenuItem("Hello");
-						ImGui::MenuItem("Sailor");
-						ImGui::EndMenu();
+						start_region_id = i;
+						reachability_revision = -1;
+						UpdateReachability();
 					}
-					ImGui::EndMenu();
+					ImGui::PopID();
 				}
-				if (ImGui::MenuItem("Save", "Ctrl+S")) {}
-				if (ImGui::MenuItem("Save As..")) {}
 
-				ImGui::Separator();
-				if (ImGui::BeginMenu("Options"))
-				{
-					static bool enabled = true;
-					ImGui::MenuItem("Enabled", "", &enabled);
-					ImGui::BeginChild("child", ImVec2(0, 60), true);
-					for (int i = 0; i < 10; i++)
-						ImGui::Text("Scrolling Text %d", i);
-					ImGui::EndChild();
-					static float f = 0.5f;
-					static int n = 0;
-					ImGui::SliderFloat("Value", &f, 0.0f, 1.0f);
-					ImGui::InputFloat("Input", &f, 0.1f);
-					ImGui::Combo("Combo", &n, "Yes\0No\0Maybe\0\0");
-					ImGui::EndMenu();
-				}
-				if (ImGui::BeginMenu("Colors"))
+				ImGui::EndCombo();
+			}
+
+			ImGui::Text("Reachable: %d / %d", reachability.reachable_count, (int)regions.size());
+			ImGui::SeparatorText("Inventory");
+
+			auto &dictionary = item_dictionary_c::Global();
+			for (int item_id = 0, len = dictionary.Count(); item_id < len; ++item_id)
+			{
+				bool held = reachability.inventory.Test(item_id);
+				if (ImGui::Checkbox(dictionary.Name(item_id).c_str(), &held))
 				{
-					float sz = ImGui::GetTextLineHeight();
-					for (int i = 0; i < ImGuiCol_COUNT; i++)
+					if (held == true)
 					{
-						const char* name = ImGui::GetStyleColorName((ImGuiCol)i);
-						ImVec2 p = ImGui::GetCursorScreenPos();
-						ImGui::GetWindowDrawList()->AddRectFilled(p, ImVec2(p.x + sz, p.y + sz), ImGui::GetColorU32((ImGuiCol)i));
-						ImGui::Dummy(ImVec2(sz, sz));
-						ImGui::SameLine();
-						ImGui::MenuItem(name);
+						reachability.AddItem(item_id);
+					}
+					else
+					{
+						reachability.RemoveItem(item_id);
 					}
-					ImGui::EndMenu();
 				}
-				if (ImGui::MenuItem("Checked", NULL, true)) {}
-				ImGui::Separator();
-				if (ImGui::MenuItem("Quit", "Alt+F4")) {}
-
-				ImGui::EndMenu();
-			}
-
-			if (ImGui::BeginMenu("Edit"))
-			{
-				if (ImGui::MenuItem("Undo", "CTRL+Z")) {}
-				if (ImGui::MenuItem("Redo", "CTRL+Y", false, false)) {}  // Disabled item
-				ImGui::Separator();
-				if (ImGui::MenuItem("Cut", "CTRL+X")) {}
-				if (ImGui::MenuItem("Copy", "CTRL+C")) {}
-				if (ImGui::MenuItem("Paste", "CTRL+V")) {}
-				ImGui::EndMenu();
 			}
-
-			ImGui::EndMainMenuBar();
 		}
+		ImGui::End();
 	}
 
-	void ValidateRegionTitle(region_c &region, int region_id)
+	void DrawSeedGenerator(void)
 	{
-		std::string new_title = region.title;
-		int append_num = 1;
+		if (ImGui::Begin("Seed Generator", &show_seed_generator))
+		{
+			ImGui::InputInt("Seeds", &seed_count, 100, 1000);
+			ImGui::InputInt("First Seed", &base_seed);
+			seed_count = std::max(1, seed_count);
+			base_seed = std::max(0, base_seed);
 
-		int i = 0;
-		int len = (int)regions.size();
+			const char *start_title = (start_region_id >= 0 && start_region_id < (int)regions.size())
+				? regions[start_region_id].title.c_str() : "(none)";
+			ImGui::Text("Start Region: %s", start_title);
 
-		bool valid = false;
-		while (valid == false)
-		{
-			valid = true;
+			if (seed_runner.busy == true)
+			{
+				const int done = seed_runner.progress;
+				ImGui::ProgressBar((float)done / (float)std::max(1, seed_runner.requested), ImVec2(-FLT_MIN, 0),
+					(std::to_string(done) + " / " + std::to_string(seed_runner.requested)).c_str());
 
-			for (int i = 0; i < len; ++i)
+				if (ImGui::Button("Cancel"))
+				{
+					seed_runner.Cancel();
+				}
+			}
+			else
 			{
-				if (i == region_id)
+				ImGui::BeginDisabled(cur_map == nullptr);
+				if (ImGui::Button("Generate"))
 				{
-					continue;
+					seed_runner.Start(cur_map, regions, start_region_id, seed_count, (uint64_t)base_seed);
 				}
+				ImGui::EndDisabled();
+			}
+
+			std::lock_guard<std::mutex> lock(seed_runner.report_mutex);
+			if (seed_runner.has_report == true)
+			{
+				const auto &report = seed_runner.report;
 
-				const auto &other = regions[i];
-				if (new_title.compare(other.title) == 0)
+				ImGui::SeparatorText("Last Run");
+				ImGui::Text("Generated: %d / %d", report.generated, report.requested);
+				ImGui::Text("Filled: %d", report.filled);
+				ImGui::Text("Beatable: %d", report.beatable);
+				ImGui::Text("%.3f s, %.1f seeds/sec", report.seconds, report.SeedsPerSecond());
+
+				for (uint64_t seed : report.failed_seeds)
 				{
-					append_num++;
-					new_title = region.title + " (" + std::to_string(append_num) + ")";
-					valid = false;
-					break;
+					ImGui::Text("Failed seed %llu", (unsigned long long)seed);
 				}
 			}
 		}
-
-		region.title = new_title;
-	}
-
-	void NewRegion(void)
-	{
-		int region_id = regions.size();
-		auto &new_region = regions.emplace_back();
-		ValidateRegionTitle(new_region, region_id);
+		ImGui::End();
 	}
 
 	bool DoFrame(void)
 	{
-		bool done = Frame_Poll();
+		bool done = false;
+
+		{
+			profile_scope_c scope(profiler, profiler_c::STAGE_POLL);
+			done = Frame_Poll();
+		}
+
 		Frame_Init();
 
-		static bool show_demo_window = true;
+		if (redraw_frames > 0)
+		{
+			redraw_frames--;
+		}
+
+		std::shared_ptr<map_c> loaded_map = map_loader.Poll();
+		if (loaded_map != nullptr)
+		{
+			cur_map = loaded_map;
+			AdoptCurrentMap();
+			RebuildRegionShapes();
+			redraw_frames = REDRAW_SETTLE_FRAMES;
+		}
+
 		if (show_demo_window)
 		{
 			ImGui::ShowDemoWindow(&show_demo_window);
 		}
 
-		DrawRegions();
-		DrawMap();
+		{
+			profile_scope_c scope(profiler, profiler_c::STAGE_REGIONS);
+			DrawRegions();
+		}
+
+		{
+			profile_scope_c scope(profiler, profiler_c::STAGE_MAP);
+			DrawMap();
+		}
+
+		{
+			profile_scope_c scope(profiler, profiler_c::STAGE_MENU_BAR);
+			DrawMenuBar();
+		}
+
+		if (imgui.io.WantTextInput == false && imgui.io.KeyCtrl == true)
+		{
+			if (ImGui::IsKeyPressed(ImGuiKey_Z))
+			{
+				if (imgui.io.KeyShift == true)
+				{
+					Redo();
+				}
+				else
+				{
+					Undo();
+				}
+			}
+			else if (ImGui::IsKeyPressed(ImGuiKey_Y))
+			{
+				Redo();
+			}
+			else if (project_path.size() > 0)
+			{
+				if (ImGui::IsKeyPressed(ImGuiKey_S, false))
+				{
+					SaveProject();
+				}
+				else if (ImGui::IsKeyPressed(ImGuiKey_O, false))
+				{
+					OpenProject();
+				}
+			}
+		}
+
+		if (show_profiler == true)
+		{
+			DrawProfiler();
+		}
+
+		if (show_reachability == true)
+		{
+			DrawReachability();
+		}
 
-		DrawMenuBar();
+		if (show_seed_generator == true)
+		{
+			DrawSeedGenerator();
+		}
 
 		if (ImGui::Begin("Regions"))
 		{
@@ -954,6 +7892,14 @@ public:
 				NewRegion();
 			}
 
+			ImGui::SameLine();
+			ImGui::BeginDisabled(cur_map == nullptr);
+			if (ImGui::Button("Seed From Map"))
+			{
+				SeedRegionsFromMap();
+			}
+			ImGui::EndDisabled();
+
 			if (ImGui::BeginChild("region_list", ImVec2(0, 160), true))
 			{
 				for (int i = 0, len = (int)regions.size(); i < len; ++i)
@@ -969,7 +7915,8 @@ public:
 						int i_next = i + (ImGui::GetMouseDragDelta(ImGuiMouseButton_Left).y < 0.f ? -1 : 1);
 						if (i_next >= 0 && i_next < len)
 						{
-							std::iter_swap(regions.begin() + i, regions.begin() + i_next);
+							MoveRegion(i, i_next);
+							history.RecordMove(i, i_next);
 							selected_region_id = i_next;
 							ImGui::ResetMouseDragDelta();
 						}
@@ -984,44 +7931,132 @@ public:
 
 				static std::string title_input = "";
 				static int old_selection = -1;
+				static bool title_active = false;
 
-				if (old_selection != selected_region_id)
+				// Follow the title when it changes from elsewhere, like an undo
+				if (old_selection != selected_region_id || title_active == false)
 				{
 					title_input = region.title;
 					old_selection = selected_region_id;
 				}
 
 				ImGui::InputText("Title", &title_input, ImGuiInputTextFlags_EnterReturnsTrue);
+				title_active = ImGui::IsItemActive();
 				if (ImGui::IsItemDeactivatedAfterEdit())
 				{
 					if (title_input.size() > 0)
 					{
-						region.title = title_input;
-						ValidateRegionTitle(region, selected_region_id);
+						const std::string old_title = region.title;
+						SetRegionTitle(selected_region_id, title_input);
+
+						if (region.title != old_title)
+						{
+							history.RecordTitle(selected_region_id, old_title, region.title);
+							MarkRegionsChanged(selected_region_id);
+						}
 					}
 					title_input = region.title;
 				}
 
-				if (ImGui::InputFloat4("Bounding Box", &region.rect_vertex_a.x, "%.0f"))
+				const ImVec2 before_a = region.rect_vertex_a;
+				const ImVec2 before_b = region.rect_vertex_b;
+
+				ImGui::BeginDisabled(region.sector_ids.size() > 0);
+				const bool rect_edited = ImGui::InputFloat4("Bounding Box", &region.rect_vertex_a.x, "%.0f");
+				ImGui::EndDisabled();
+
+				if (rect_edited == true)
 				{
 					region.rect_vertex_a.x = std::clamp(region.rect_vertex_a.x, GRID_MIN, GRID_MAX);
 					region.rect_vertex_a.y = std::clamp(region.rect_vertex_a.y, GRID_MIN, GRID_MAX);
 					region.rect_vertex_b.x = std::clamp(region.rect_vertex_b.x, GRID_MIN, GRID_MAX);
 					region.rect_vertex_b.y = std::clamp(region.rect_vertex_b.y, GRID_MIN, GRID_MAX);
+					region.FitPolygonToRect(before_a, before_b);
+					history.RecordRect(selected_region_id, before_a, before_b, region.rect_vertex_a, region.rect_vertex_b);
+					MarkRegionsChanged(selected_region_id);
 				}
+
+				ImGui::Text("Things: %d", RegionThingCount(selected_region_id));
+
+				DrawShapeEditor(region);
+				DrawRuleEditor(region);
 			}
 		}
 		ImGui::End();
 
-		Frame_Process();
+		// A drag or a field being typed into is one continuous edit until it lets go
+		if (ImGui::IsMouseDown(ImGuiMouseButton_Left) == false && ImGui::IsAnyItemActive() == false)
+		{
+			history.Seal();
+		}
+
+		{
+			profile_scope_c scope(profiler, profiler_c::STAGE_PROCESS);
+			Frame_Process();
+		}
+
 		return done;
 	}
 
+	void RequestMap(const std::string &path, const std::string &name)
+	{
+		// The current map stays up until the new one is ready.
+		map_loader.Start(path, name);
+		printf("Requested map %s from %s\n", name.c_str(), path.c_str());
+	}
+
 	void LoadGenericMap(void)
 	{
-		wad_c wad = wad_c("MAP01.wad");
-		cur_map = new map_c(wad, "MAP01");
-		printf("Created map\n");
+		RequestMap(wad_path, map_name);
+	}
+
+	// Safe to call from any thread; wakes the frame loop up if it's waiting.
+	void Wake(void)
+	{
+		SDL_Event event = {};
+		event.type = wake_event;
+		SDL_PushEvent(&event);
+	}
+
+	// Things that change on screen without any input coming in
+	bool IsAnimating(void)
+	{
+		return (map_loader.busy == true
+			|| seed_runner.busy == true
+			|| imgui.io.WantTextInput == true
+			|| show_demo_window == true);
+	}
+
+	bool NeedsRedraw(void)
+	{
+		if (event_driven == false)
+		{
+			return true;
+		}
+
+		if ((SDL_GetWindowFlags(sdl.window) & SDL_WINDOW_MINIMIZED) != 0)
+		{
+			return false;
+		}
+
+		return (redraw_frames > 0 || IsAnimating() == true);
+	}
+
+	void LimitFrameRate(Uint64 frame_start)
+	{
+		if (frame_rate_cap <= 0)
+		{
+			return;
+		}
+
+		const Uint64 frequency = SDL_GetPerformanceFrequency();
+		const Uint64 frame_ticks = frequency / frame_rate_cap;
+		const Uint64 elapsed = SDL_GetPerformanceCounter() - frame_start;
+
+		if (elapsed < frame_ticks)
+		{
+			SDL_Delay((Uint32)(((frame_ticks - elapsed) * 1000) / frequency));
+		}
 	}
 
 	void Loop(void)
@@ -1031,7 +8066,30 @@ public:
 		bool done = false;
 		while (done == false)
 		{
-			done = DoFrame();
+			// Checked even while idle; the wait below times out often enough for it
+			Autosave();
+
+			if (NeedsRedraw() == false)
+			{
+				// Sleep until there's input, or a background thread wakes us.
+				// The timeout is only a safety net; nothing is drawn if it expires.
+				if (SDL_WaitEventTimeout(nullptr, IDLE_WAIT_MS) == SDL_FALSE)
+				{
+					continue;
+				}
+
+				redraw_frames = REDRAW_SETTLE_FRAMES;
+			}
+
+			const Uint64 frame_start = SDL_GetPerformanceCounter();
+
+			{
+				profile_scope_c scope(profiler, profiler_c::STAGE_FRAME);
+				done = DoFrame();
+			}
+
+			profiler.EndFrame();
+			LimitFrameRate(frame_start);
 		}
 	}
 };
@@ -1039,6 +8097,15 @@ public:
 // Main code
 int main(int argc, char **argv)
 {
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--batch") == 0)
+		{
+			class batch_c batch;
+			return batch.Run(argc, argv);
+		}
+	}
+
 	class main_c main_state;
 
 	if (main_state.sdl.window == nullptr)